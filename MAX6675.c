@@ -1,14 +1,18 @@
+#include <math.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
-#include <wiringPi.h>
-
 #include "MAX6675.h"
+#include "hal.h"
 
 
 #define MAX6675_CLOCK_SPEED 4000000
+#define MAX6675_OPEN_BIT    0x0004
+#define MAX6675_ZERO_BITS   0x8002	// D15 dummy sign bit and D1 device ID, both always 0
+#define MAX6675_ZERO_DROP   10.0	// degrees C above 0 the last good reading must be for an all zeros word to count as a fault
 
 MAX6675 MAX6675Setup(int SPIChannel) {
-	if (wiringPiSPISetup(SPIChannel, MAX6675_CLOCK_SPEED) == -1) {
+	if (HalSpiSetup(SPIChannel, MAX6675_CLOCK_SPEED) == -1) {
 		return 0;
 	}
 
@@ -16,6 +20,10 @@ MAX6675 MAX6675Setup(int SPIChannel) {
 
 	max6675->SPIChannel = SPIChannel;
 	max6675->scale = MAX6675_CELSIUS;
+	max6675->cached = false;
+	max6675->lastGood = 0;
+	max6675->transfers = 0;
+	max6675->lastTransferNs = 0;
 
 	return max6675;
 }
@@ -40,47 +48,142 @@ MAX6675TempScale MAX6675GetScale(MAX6675 max6675) {
 	return MAX6675_CELSIUS;
 }
 
-float MAX6675GetTempC(MAX6675 max6675) {
+// Fetches the raw 16 bit word, from the cache while a conversion is still running
+static MAX6675Status read_raw(MAX6675 max6675, unsigned short* raw) {
+	*raw = 0;
 	if (max6675 == 0) {
-		return 0.0f;
+		return MAX6675_NO_HANDLE;
 	}
 
-	char buffer[2] = {0, 0};
+	uint64_t now = HalNow();
+	if (!max6675->cached || now - max6675->readAt >= MAX6675_CONVERSION_MS * 1000000ULL) {
+		unsigned char buffer[2] = {0, 0};
+
+		int ret = HalSpiTransfer(max6675->SPIChannel, buffer, 2);
+
+		max6675->transfers++;
+		max6675->lastTransferNs = HalNow() - now;
+
+		if (ret != 2) {
+			max6675->cached = false;
+			return MAX6675_SPI_ERROR;
+		}
+
+		max6675->raw = (buffer[0] << 8) | buffer[1];
+		max6675->readAt = now;
+		max6675->cached = true;
+	}
+
+	*raw = max6675->raw;
+
+	// D15 and D1 always read 0 on a real chip, so an all ones word means
+	// nothing drove MISO.  All zeros is also what MISO stuck low or an
+	// unpowered chip reads, but it is a real 0 degrees too.  A thermocouple
+	// can't fall MAX6675_ZERO_DROP degrees in one conversion, so it only
+	// counts as a fault after a warmer reading.  lastGood is left alone
+	// then, and the zeros stay a fault until the bus reads something else.
+	if ((*raw & MAX6675_ZERO_BITS)
+		|| (*raw == 0x0000 && (max6675->lastGood >> 3) * 0.25 > MAX6675_ZERO_DROP)) {
+		return MAX6675_SPI_ERROR;
+	}
+	if (*raw & MAX6675_OPEN_BIT) {
+		return MAX6675_OPEN_THERMOCOUPLE;
+	}
+	max6675->lastGood = *raw;
+	return MAX6675_OK;
+}
+
+static bool read_celsius(MAX6675 max6675, float* celsius) {
+	unsigned short raw;
+
+	if (read_raw(max6675, &raw) != MAX6675_OK) {
+		return false;
+	}
+
+	*celsius = (raw >> 3) * 0.25;
+	return true;
+}
+
+static float to_scale(MAX6675TempScale scale, float celsius) {
+	switch(scale) {
+		case MAX6675_KELVIN:
+			return celsius + 273.15;
+
+		case MAX6675_FAHRENHEIT:
+			return (celsius * 1.8) + 32.0;
+
+		default:
+			return celsius;
+	}
+}
 
-	int ret = wiringPiSPIDataRW(max6675->SPIChannel, buffer, 2);
+static float get_temp(MAX6675 max6675, MAX6675TempScale scale) {
+	float celsius;
 
-	if (ret != 2) {
+	if (!read_celsius(max6675, &celsius)) {
 		return 0.0f;
 	}
 
-	short reading = (buffer[0] << 8) + buffer[1];
-	reading >>= 3;
+	return to_scale(scale, celsius);
+}
 
-	return reading * 0.25;
+float MAX6675GetTempC(MAX6675 max6675) {
+	return get_temp(max6675, MAX6675_CELSIUS);
 }
 
 
 float MAX6675GetTempK(MAX6675 max6675) {
-	return MAX6675GetTempC(max6675) + 273.15;
+	return get_temp(max6675, MAX6675_KELVIN);
 }
 
 float MAX6675GetTempF(MAX6675 max6675) {
-	return (MAX6675GetTempC(max6675) * 1.8) + 32.0;
+	return get_temp(max6675, MAX6675_FAHRENHEIT);
 }
 
 float MAX6675GetTemp(MAX6675 max6675) {
 	if (max6675) {
-		switch(max6675->scale) {
-			case MAX6675_KELVIN:
-				return MAX6675GetTempK(max6675);
+		return get_temp(max6675, max6675->scale);
+	} else {
+		return 0.0f;
+	}
+}
+
+MAX6675Status MAX6675Read(MAX6675 max6675, MAX6675Reading* reading) {
+	reading->status = read_raw(max6675, &reading->raw);
+	reading->value = (reading->status == MAX6675_OK)
+		? to_scale(max6675->scale, (reading->raw >> 3) * 0.25)
+		: NAN;
+
+	return reading->status;
+}
 
-			case MAX6675_FAHRENHEIT:
-				return MAX6675GetTempF(max6675);
+const char* MAX6675StatusStr(MAX6675Status status) {
+	switch(status) {
+		case MAX6675_OK:
+			return "ok";
 
-			default:
-				return MAX6675GetTempC(max6675);
+		case MAX6675_NO_HANDLE:
+			return "no probe";
+
+		case MAX6675_SPI_ERROR:
+			return "spi error";
+
+		case MAX6675_OPEN_THERMOCOUPLE:
+			return "open thermocouple";
+
+		default:
+			return "unknown";
+	}
+}
+
+int MAX6675ReadAll(MAX6675 handles[], int count, MAX6675Reading out[]) {
+	int good = 0;
+
+	for (int i = 0; i < count; i++) {
+		if (MAX6675Read(handles[i], &out[i]) == MAX6675_OK) {
+			good++;
 		}
-	} else {
-		return 0.0f;
 	}
+
+	return good;
 }
@@ -1,6 +1,13 @@
 #ifndef MAX6675_H
 #define MAX6675_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// The chip restarts its conversion whenever it is read, so readings inside
+// this window are served from the handle instead of the bus
+#define MAX6675_CONVERSION_MS 220
+
 typedef enum {
 	MAX6675_CELSIUS,
 	MAX6675_KELVIN,
@@ -8,9 +15,33 @@ typedef enum {
 } MAX6675TempScale;
 
 
+typedef enum {
+	MAX6675_OK = 0,
+	MAX6675_NO_HANDLE,		// setup failed or no handle was given
+	MAX6675_SPI_ERROR,		// transfer failed, D15 or D1 set (stuck high), or all zeros right after a reading above 10 C (stuck low)
+	MAX6675_OPEN_THERMOCOUPLE	// D2 set, the probe is unplugged or broken
+} MAX6675Status;
+
+typedef struct MAX6675Reading {
+	float		value;	// in the handle's scale, NAN unless status is MAX6675_OK
+	MAX6675Status	status;
+	unsigned short	raw;	// word as read off the bus, 0 if none was read
+} MAX6675Reading;
+
+
 typedef struct MAX6675 {
 	int	SPIChannel;
 	MAX6675TempScale scale;
+
+	// Last conversion read off the bus
+	bool		cached;
+	unsigned short	raw;
+	uint64_t	readAt;		// HalNow() of the read
+	unsigned short	lastGood;	// last word that decoded as a temperature, 0 if none yet
+
+	// Bus statistics for instrumentation
+	unsigned long	transfers;	// SPI transactions issued, cached reads excluded
+	unsigned long	lastTransferNs;	// duration of the most recent transaction
 } *MAX6675;
 
 
@@ -20,10 +51,24 @@ void MAX6675Free(MAX6675 handle);
 void MAX6675SetScale(MAX6675 handle, MAX6675TempScale scale);
 MAX6675TempScale MAX6675GetScale(MAX6675 handle);
 
+// The GetTemp functions return 0.0 in every scale on any failure, use
+// MAX6675Read to tell a real 0 degrees from a fault.
+//
+// An all zeros word is what MISO stuck low reads as, and also a real
+// 0 C.  It is taken as a reading at start up or after one within 10 C of
+// zero, and as MAX6675_SPI_ERROR after a warmer one, until the bus reads
+// anything else.
 float MAX6675GetTempC(MAX6675 handle);
 float MAX6675GetTempK(MAX6675 handle);
 float MAX6675GetTempF(MAX6675 handle);
 
 float MAX6675GetTemp(MAX6675 handle);
 
+MAX6675Status MAX6675Read(MAX6675 handle, MAX6675Reading* reading);
+const char* MAX6675StatusStr(MAX6675Status status);
+
+// Reads every probe in one pass, each on its own chip select.  out[i] is
+// the reading of handles[i].  Returns the number of good readings.
+int MAX6675ReadAll(MAX6675 handles[], int count, MAX6675Reading out[]);
+
 #endif
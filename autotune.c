@@ -0,0 +1,112 @@
+#include <math.h>
+#include <string.h>
+
+#include "autotune.h"
+
+
+static const char* stateNames[] = { "idle", "running", "done", "failed" };
+
+const char* AutotuneStateStr(AutotuneState state) {
+	if (state < AUTOTUNE_IDLE || state > AUTOTUNE_FAILED) {
+		return "unknown";
+	}
+	return stateNames[state];
+}
+
+void AutotuneStart(Autotune* tune, const AutotuneConfig* config, double setPoint, double bias) {
+	memset(tune, 0, sizeof(*tune));
+	tune->config = *config;
+	tune->state = AUTOTUNE_RUNNING;
+	tune->setPoint = setPoint;
+
+	// Keep both relay outputs inside 0-100
+	double step = config->step;
+	bias = fmax(bias, step);
+	bias = fmin(bias, 100.0 - step);
+	tune->bias = bias;
+
+	tune->lastRise = -1.0;
+	tune->max = -INFINITY;
+	tune->min = INFINITY;
+}
+
+void AutotuneAbort(Autotune* tune, const char* reason) {
+	if (tune->state == AUTOTUNE_RUNNING) {
+		tune->state = AUTOTUNE_FAILED;
+		tune->reason = reason;
+	}
+}
+
+static void finish(Autotune* tune) {
+	const AutotuneConfig* config = &tune->config;
+	int cycles = tune->seen - 1;
+	double a = tune->sumAmplitude / cycles;
+	double h = config->hysteresis;
+
+	if (a <= h) {
+		AutotuneAbort(tune, "oscillation inside the hysteresis band");
+		return;
+	}
+
+	tune->tu = tune->sumPeriod / cycles;
+	tune->ku = 4.0 * config->step / (M_PI * sqrt(a * a - h * h));
+
+	double kp, ti, td;
+	if (config->rule == AUTOTUNE_ZIEGLER_NICHOLS) {
+		kp = 0.6 * tune->ku;
+		ti = tune->tu / 2.0;
+		td = tune->tu / 8.0;
+	} else {
+		kp = tune->ku / 2.2;
+		ti = 2.2 * tune->tu;
+		td = tune->tu / 6.3;
+	}
+
+	tune->gains.kp = kp;
+	tune->gains.ki = kp / ti;
+	tune->gains.kd = kp * td;
+	tune->state = AUTOTUNE_DONE;
+}
+
+double AutotuneStep(Autotune* tune, double measurement, double dt) {
+	const AutotuneConfig* config = &tune->config;
+
+	if (tune->state != AUTOTUNE_RUNNING) {
+		return tune->bias;
+	}
+
+	tune->elapsed += dt;
+	if (tune->elapsed > config->timeoutS) {
+		AutotuneAbort(tune, "timed out before the pit oscillated");
+		return tune->bias;
+	}
+
+	tune->max = fmax(tune->max, measurement);
+	tune->min = fmin(tune->min, measurement);
+
+	if (tune->high && measurement > tune->setPoint + config->hysteresis) {
+		tune->high = false;
+	}
+	else if (!tune->high && measurement < tune->setPoint - config->hysteresis) {
+		tune->high = true;
+
+		// A cycle runs from one switch to high to the next, the first one
+		// still carries the approach to the set point
+		if (tune->lastRise >= 0.0) {
+			if (++tune->seen > 1) {
+				tune->sumPeriod += tune->elapsed - tune->lastRise;
+				tune->sumAmplitude += (tune->max - tune->min) / 2.0;
+			}
+			if (tune->seen > config->cycles) {
+				tune->high = false;
+				finish(tune);
+				return tune->bias;
+			}
+		}
+		tune->lastRise = tune->elapsed;
+		tune->max = -INFINITY;
+		tune->min = INFINITY;
+	}
+
+	return tune->high ? tune->bias + config->step : tune->bias - config->step;
+}
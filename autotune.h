@@ -0,0 +1,70 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdbool.h>
+
+#include "controller.h"
+
+// Relay autotune (Astrom-Hagglund).
+//
+// The fan is switched between bias + step and bias - step whenever the pit
+// leaves a band around the set point.  The pit settles into a limit cycle
+// whose period is the ultimate period Tu and whose amplitude gives the
+// ultimate gain Ku = 4 step / (pi sqrt(a^2 - h^2)).  PID gains follow from
+// Tyreus-Luyben, or Ziegler-Nichols for a faster, more aggressive loop.
+
+typedef enum {
+	AUTOTUNE_IDLE,
+	AUTOTUNE_RUNNING,
+	AUTOTUNE_DONE,
+	AUTOTUNE_FAILED,
+} AutotuneState;
+
+typedef enum {
+	AUTOTUNE_TYREUS_LUYBEN,
+	AUTOTUNE_ZIEGLER_NICHOLS,
+} AutotuneRule;
+
+typedef struct AutotuneConfig {
+	double		step;		// % the relay swings either side of the bias
+	double		hysteresis;	// degrees either side of the set point before switching
+	int		cycles;		// oscillations averaged, after the first is discarded
+	int		timeoutS;	// gives up after this long
+	AutotuneRule	rule;
+} AutotuneConfig;
+
+typedef struct Autotune {
+	AutotuneConfig	config;
+	AutotuneState	state;
+	const char*	reason;		// why a run failed
+
+	double		setPoint;
+	double		bias;
+	bool		high;		// relay at bias + step
+	double		elapsed;	// seconds since start
+
+	double		lastRise;	// elapsed at the last switch to high, < 0 before the first
+	double		max;		// extremes of the cycle in progress
+	double		min;
+	int		seen;		// complete cycles, including the discarded first
+	double		sumPeriod;
+	double		sumAmplitude;
+
+	double		ku;
+	double		tu;
+	ControllerGains	gains;		// kp, ki, kd filled in once DONE
+} Autotune;
+
+
+// Starts a run around setPoint, bias is the duty the fan holds on average
+void AutotuneStart(Autotune* tune, const AutotuneConfig* config, double setPoint, double bias);
+
+// Feeds the filtered pit temperature, returns the fan duty to apply.  On
+// the step that completes the run state turns DONE and bias is returned.
+double AutotuneStep(Autotune* tune, double measurement, double dt);
+
+void AutotuneAbort(Autotune* tune, const char* reason);
+
+const char* AutotuneStateStr(AutotuneState state);
+
+#endif
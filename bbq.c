@@ -1,20 +1,46 @@
 /* Hardware PWM fan control with Thermovouple input to calculate the fan speed */
 
-#include <wiringPi.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <math.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <pthread.h>
 #include <arpa/inet.h>
+#include <stdatomic.h>
 #include <microhttpd.h>
 #include "MAX6675.h"
+#include "autotune.h"
+#include "checkpoint.h"
+#include "config.h"
+#include "controller.h"
+#include "cooklog.h"
+#include "eta.h"
+#include "events.h"
+#include "fan.h"
+#include "filter.h"
+#include "hal.h"
+#include "history.h"
+#include "json.h"
+#include "lid.h"
+#include "log.h"
+#include "metrics.h"
+#include "mqtt.h"
+#include "plant.h"
+#include "rt.h"
+#include "pwmclock.h"
+#include "seqlock.h"
+#include "spsc.h"
+#include "state.h"
+#include "status.h"
+#include "tach.h"
+#include "ticker.h"
 
 // These values are fixed by Homekit
 //
@@ -27,59 +53,121 @@ typedef enum {
 
 static char* CoolingStateStr[] = { "Off", "Heat", "Cool", "Auto" };
 
-static CoolingState targetState     = 0;
-static double targetTemp            = 15.0;
-static CoolingState currentState    = CoolingState_Off;
-static double currentTemp           = 1000.0;
-static bool End                     = false;
+// Controller selection and gains, written by HTTP handlers and picked up
+// by heartThread at the start of the next cycle
+//
+typedef struct ControllerSettings {
+    ControllerType  type;
+    ControllerGains gains;
+} ControllerSettings;
+
+// One smoker: a pit probe, a fan, a controller and the target it holds.
+// Set points are written by HTTP and MQTT handlers and read by heartThread,
+// the rest belongs to heartThread.  Everything the handlers report back
+// comes from the zone's published BBQState snapshot.
+//
+typedef struct Zone {
+    _Atomic CoolingState targetState;
+    _Atomic double  targetTemp;
+    _Atomic double  overrideTemp;       // set by /currentTemperature, consumed by heartThread
+    atomic_uint     rearmCount;         // bumped on every mode write, clears a latched probe fault
+
+    char            tag[16];            // log prefix, empty with a single zone
+    int             controlProbe;
+    Fan             fan;
+    Controller      controller;
+    ControllerSettings settings;
+    unsigned int    settingsVersion;
+    CoolingState    target;             // set points of the current cycle
+    double          setPoint;
+    CoolingState    currentState;
+    double          currentTemp;
+    bool            measured;           // currentTemp has come from the probe or a client since start up
+    double          currentSpeed;
+    Lid             lid;
+    bool            lidOpen;
 
+    // Probe fault latch, once set the fan stays off until the probe reads
+    // good again and the mode is written
+    int             badReads;
+    MAX6675Status   fault;
+    unsigned int    faultRearm;
+} Zone;
+
+static Zone zones[STATE_MAX_ZONES];
+static int zoneCount = 1;
+static bool End                         = false;
+
+static pthread_t acquireTid;
 static pthread_t heartTid;
-const int pwm_pin = 1;              // GPIO 1 as per WiringPi, GPIO18 as per BCM 
-const int pi_freq = 54000000;       // Base frequency of PI - 54 MHz for Pi4B (19.2MHz for older models)
-const int pwm_freq = 25000;         // Fan PWM Frequency in Hz
-const int tach_pin = 3;             // GPIO 3 as per WiringPi, GPIO22 as per BCM
-const int tach_pulse = 2;           // Number of pulses per fan revolution
-const int refresh_time = 1;         // Seconds to wait between updates
-const int bindPort = 80;            // Port used by socket
-const int debug = 1;                // Set to 1 to print debug messages or 0 to run silently
+static pthread_t saveTid;
+static Config boot;                             // configuration at start up, for settings that need a restart
 
 static int range = 0;
-static int rpm   = 0;
 
-static int currentSpeed = 0;
-static int currentRPM = 0;
-static struct timeval currentTach;
+// Set point until a checkpoint or a client gives one, the fan is off anyway
+//
+#define BOOT_TARGET_TEMP 15.0
 
-// Sets fan percentage speed 
+// The last run's state when its checkpoint was recent enough to carry on from
 //
-void set_speed(int speed)
-{
-    if (currentSpeed != speed)
-    {
-        speed = (speed > 100) ? 100 : (speed < 0) ? 0 : speed; // make sure speed is in range 0-100
-        int duty = range * speed / 100;
-        pwmWrite(pwm_pin, duty);
-        currentSpeed = speed;
-        if (debug) printf("set speed : %d%%\n",speed);
-    }
-}
+static Checkpoint resume;
+static bool resumed = false;
+
+// Software PWM runs in 100 us steps, 100 of them make a 100 Hz fan signal
+// with 1% resolution
+//
+#define SOFT_PWM_RANGE 100
+
+static atomic_ulong settingsData[STATE_MAX_ZONES][SEQLOCK_WORDS(ControllerSettings)];
+static SeqLock settingsLocks[STATE_MAX_ZONES] = {
+    SEQLOCK_INIT(ControllerSettings, settingsData[0]),
+    SEQLOCK_INIT(ControllerSettings, settingsData[1]),
+};
+static pthread_mutex_t settingsWriteLock = PTHREAD_MUTEX_INITIALIZER;
 
-// Get fan RPM 
+// Autotune runs inside heartThread on one zone at a time, /autotune asks
+// for a start (zone + 1) or an abort (-(zone + 1)) and reads back the last
+// published state of the run
 //
-void get_rpm(void)
+static atomic_int autotuneRequest = 0;
+static atomic_int autotuneZone = 0;
+SEQLOCK_DEFINE(autotuneLock, Autotune);
+
+// One cycle of probe readings, handed from acquireThread to heartThread
+//
+typedef struct Acquisition {
+    uint64_t        ns;             // HalNow() time of the reads
+    MAX6675Reading  readings[STATE_MAX_PROBES];
+} Acquisition;
+
+SPSC_DEFINE(acquired, Acquisition, 8);
+
+// Gains of a finished autotune on their way to the config file
+//
+typedef struct GainsUpdate {
+    char        section[16];
+    ConfigPair  pairs[4];
+} GainsUpdate;
+
+SPSC_DEFINE(gainsToSave, GainsUpdate, 4);
+
+// Sets a zone's fan percentage speed, fractions of a percent reach the PWM range
+//
+void set_speed(Zone* zone, double speed)
 {
-  struct timeval current_time;
-  gettimeofday(&current_time, NULL);
-  int dt = 1000000 * (current_time.tv_sec - currentTach.tv_sec) + current_time.tv_usec - currentTach.tv_usec;
-  currentTach = current_time;
-  if (dt > 0) rpm =  1000000 / dt / tach_pulse * 60;
+    unsigned long writes = zone->fan->writes;
+
+    zone->currentSpeed = FanSet(zone->fan, speed);
+    if (zone->fan->writes != writes) Log(LOG_LEVEL_DEBUG, "%sset speed : %.1f%%", zone->tag, zone->currentSpeed);
 }
 
 // Print error message and exit 
 //
 void error(char *message)
 {
-  printf("Error : %s\n", message);
+  Log(LOG_LEVEL_ERROR, "Error : %s", message);
+  LogClose();
   exit(1);
 }
 
@@ -87,144 +175,984 @@ void error(char *message)
 //
 int get_clock(void)
 {
-  int clock;
-  int ratio = pi_freq / pwm_freq;
-  int max_range = pi_freq / 2;
-  if (pi_freq % pwm_freq == 0) // try to find an exact match for pwm_freq
-  {
-    for (int r = (ratio < max_range) ? ratio - 1 : max_range; r > 0; r--)
-    {
-      if (ratio % r == 0 && ratio / r >= 2)
-      {
-        if (ratio / r <= 4095)
-        {
-          range = r;
-          clock = ratio / range;
-        }
-        break;
-      }
+  int pi_freq = boot.piFreq ? boot.piFreq : PwmBaseFreq();
+  PwmClock pwm;
+
+  if (!PwmClockFor(pi_freq, boot.pwmFreq, &pwm)) error("can't achieve this PWM frequency");
+  range = pwm.range;
+
+  if (!pwm.exact) Log(LOG_LEVEL_WARN, "No exact clock and range found - using %d Hz", pi_freq / pwm.clock / pwm.range);
+  Log(LOG_LEVEL_DEBUG, "base freq : %d Hz, clock div : %d, range : %d", pi_freq, pwm.clock, pwm.range);
+
+  return pwm.clock;
+}
+
+// Apply the gains of a finished autotune and save them to the config file
+//
+static void autotune_done(const Autotune* tune, int id, double measurement)
+{
+    Zone* zone = &zones[id];
+    ControllerSettings settings;
+
+    pthread_mutex_lock(&settingsWriteLock);
+    SeqLockRead(&settingsLocks[id], &settings);
+    settings.type = CONTROLLER_PID;
+    settings.gains.kp = tune->gains.kp;
+    settings.gains.ki = tune->gains.ki;
+    settings.gains.kd = tune->gains.kd;
+    SeqLockWrite(&settingsLocks[id], &settings);
+    pthread_mutex_unlock(&settingsWriteLock);
+
+    // Hand over at the relay bias rather than stepping the fan
+    zone->settings = settings;
+    ControllerSetGains(zone->controller, &settings.gains);
+    ControllerSetType(zone->controller, settings.type);
+    ControllerReset(zone->controller, measurement, tune->bias);
+
+    Log(LOG_LEVEL_INFO, "%sautotune : ku=%.3f tu=%.0fs, kp=%.3f ki=%.5f kd=%.2f", zone->tag,
+        tune->ku, tune->tu, settings.gains.kp, settings.gains.ki, settings.gains.kd);
+
+    // Zone 0 keeps its gains under [control], the others in their own section
+    char section[16] = "control";
+    if (id > 0) snprintf(section, sizeof(section), "zone%d", id);
+
+    GainsUpdate update = { .pairs = { { "controller", "pid" }, { "kp" }, { "ki" }, { "kd" } } };
+    snprintf(update.section, sizeof(update.section), "%s", section);
+    snprintf(update.pairs[1].value, sizeof(update.pairs[1].value), "%.4f", settings.gains.kp);
+    snprintf(update.pairs[2].value, sizeof(update.pairs[2].value), "%.6f", settings.gains.ki);
+    snprintf(update.pairs[3].value, sizeof(update.pairs[3].value), "%.4f", settings.gains.kd);
+    if (!SpscPush(&gainsToSave, &update)) {
+        Log(LOG_LEVEL_WARN, "%sautotune : gains not saved, writer behind", zone->tag);
     }
-  }
-  if (range == 0) // no exact match, get similar frequency
-  {
-    clock = ratio / max_range; // estimate clock for maximum range
-    clock = (clock < 2) ? 2 : (clock > 4095) ? 4095 : clock; // make sure clock is in range 2-4095
-    range = ratio / clock;
-    if (range > max_range || range < 1) error("can't achieve this PWM frequency");
-    if (debug) printf("No exact clock and range found - using %d Hz\n", pi_freq / clock / range);
-  }
-  if (debug) printf("clock div : %d, range : %d\n", clock, range);
+}
 
-  return clock;
+// saves autotuned gains to the config file off the control thread, the
+// rewrite and fsync can stall on the SD card for hundreds of ms
+//
+void * saveThread(void* arg)
+{
+    GainsUpdate update;
+
+    for (;;) {
+        while (SpscPop(&gainsToSave, &update)) {
+            if (ConfigUpdate(update.section, update.pairs, sizeof(update.pairs) / sizeof(update.pairs[0])) != 0) {
+                Log(LOG_LEVEL_WARN, "autotune : gains not saved to [%s]", update.section);
+            }
+        }
+        if (End) {
+            break;
+        }
+        SpscWait(&gainsToSave);
+    }
+    return arg;
 }
 
-// Graceful shutdown
+// Graceful shutdown, run by main once reload_loop has taken SIGINT or
+// SIGTERM, so none of this is in signal handler context.  The fans go off
+// as soon as nothing drives them any more, before the teardown that could
+// hang or abort
 //
-void shutdownTrap(int signum)
+static void shut_down(struct MHD_Daemon* d)
 {
-  printf("Shutting down...\n");
+  Log(LOG_LEVEL_INFO, "Shutting down...");
   End = true;
+  pthread_join(acquireTid, NULL);
   pthread_join(heartTid, NULL);
-  pwmWrite(pwm_pin, 0);
+  for (int i = 0; i < zoneCount; i++) HalPwmWrite(boot.zones[i].pwmPin, 0);
+
+  SpscWake(&gainsToSave);
+  pthread_join(saveTid, NULL);
+  EventsClose();
+  if (d) MHD_stop_daemon(d);
+  CheckpointClose();
+  MqttClose();
   usleep(1000000);
-  pinMode(pwm_pin, INPUT);
-  pullUpDnControl(pwm_pin, PUD_DOWN);
-  exit(0);
+  for (int i = 0; i < zoneCount; i++) HalPinRelease(boot.zones[i].pwmPin);
+  LogClose();
+}
+
+// Tachometer settings out of the configuration
+//
+static void tach_config(const Config* config, TachConfig* tach)
+{
+    tach->pulsesPerRev = config->tachPulse;
+    tach->debounceUs   = config->tachDebounceUs;
+    tach->windowMs     = config->tachWindowMs;
+    tach->stallMs      = config->tachStallMs;
+    tach->stallDuty    = config->tachStallDuty;
 }
 
 // Setup GPIO for tachometer and PWM 
 //
 void setup_gpio(void)
 {
-  if (wiringPiSetup() == -1) error("wiringPiSetup failed");
-  if (refresh_time <= 0) error("refresh_time must be at least 1");
+  SmokerConfig sim = boot.sim;
+  sim.pulsesPerRev = boot.tachPulse;
+  if (HalSetup(&sim) == -1) error("HAL setup failed");
 
   // setup rpm tachometer
-  if (tach_pulse <= 0) error("tach_pulse must be at least 1");
+  TachConfig tach;
+  tach_config(&boot, &tach);
+  TachSetup(&tach);
 
-  pinMode(tach_pin, INPUT);
-  pullUpDnControl(tach_pin, PUD_DOWN);
-  gettimeofday(&currentTach, NULL);
-  wiringPiISR(tach_pin, INT_EDGE_RISING, &get_rpm);
+  TachPins pins = { boot.tachPin, boot.tachGpioChip, boot.tachGpioLine };
+  const TachBackend* preferred = (boot.tachBackend == TachBackend_WiringPi) ? &TachBackendWiringPi : &TachBackendGpiod;
+  const TachBackend* backend = TachStart(preferred, &pins);
+  if (backend == NULL) error("can't start tachometer");
+  Log(LOG_LEVEL_DEBUG, "tach : %s backend", backend->name);
 
+  // Hardware PWM where the pin has a channel to itself, software PWM
+  // for the rest
   int clock = get_clock();
-  pinMode(pwm_pin, PWM_OUTPUT);
-  pullUpDnControl(pwm_pin, PUD_OFF);
-  pwmSetMode(PWM_MODE_MS);
-  pwmSetRange(range);
-  pwmSetClock(clock);
-  pwmWrite(pwm_pin, 0);
+  for (int i = 0; i < zoneCount; i++) {
+    int pin = boot.zones[i].pwmPin;
+    int zoneRange = range;
+
+    if (HalPwmSetup(pin, clock, range) != 0) {
+      if (HalSoftPwmSetup(pin, SOFT_PWM_RANGE) != 0) error("can't set up fan PWM");
+      zoneRange = SOFT_PWM_RANGE;
+      Log(LOG_LEVEL_INFO, "%spwm : no free hardware channel on pin %d, software PWM", zones[i].tag, pin);
+    }
+
+    zones[i].fan = FanSetup(pin, zoneRange, &boot.fan);
+    if (zones[i].fan == NULL) error("fan setup failed");
+  }
 }
 
-// heart thread is what reads the themmocouple and controls the fan
+// Zones out of the start up configuration, before any thread reads them
 //
-void * heartThread(void* arg)
+void setup_zones(void)
 {
-    MAX6675 max6675 = MAX6675Setup(0);
+    zoneCount = boot.zoneCount;
+    for (int i = 0; i < zoneCount; i++) {
+        Zone* zone = &zones[i];
 
-    setup_gpio();
+        zone->targetState  = CoolingState_Off;
+        zone->targetTemp   = BOOT_TARGET_TEMP;
+        zone->overrideTemp = NAN;
+        zone->currentState = CoolingState_Off;
+        zone->currentTemp  = boot.zones[i].controllerGains.ambient;     // stands in until the first reading
+        zone->controlProbe = boot.zones[i].controlProbe;
+        if (zoneCount > 1) snprintf(zone->tag, sizeof(zone->tag), "zone %d : ", i);
+
+        ControllerSettings settings = { boot.zones[i].controllerType, boot.zones[i].controllerGains };
+        SeqLockWrite(&settingsLocks[i], &settings);
+    }
+}
+
+// Picks up the checkpoint of the last run if it is recent enough: the set
+// points, and the fan straight back at its last speed before anything
+// slower starts up.  heartThread restores the controller and filter state
+// before its first cycle.
+//
+void restore_checkpoint(void)
+{
+    if (!boot.checkpointPath[0] || CheckpointLoad(boot.checkpointPath, &resume) != 0) {
+        return;
+    }
+
+    // A Pi without a clock may boot behind the checkpoint's time, that counts as recent
+    long age = (long)(HalTime() - resume.savedAt);
+    if (age > boot.checkpointMaxAgeS) {
+        Log(LOG_LEVEL_INFO, "checkpoint : %lds old, starting with the fan off", age);
+        return;
+    }
+
+    int count = (resume.zones < zoneCount) ? resume.zones : zoneCount;
+    for (int i = 0; i < count; i++) {
+        const CheckpointZone* saved = &resume.zone[i];
+        Zone* zone = &zones[i];
+
+        if (saved->targetState < CoolingState_Off || saved->targetState > CoolingState_Auto || !isfinite(saved->targetTemp)) {
+            continue;
+        }
+        zone->targetState = saved->targetState;
+        zone->targetTemp  = saved->targetTemp;
+        if (isfinite(saved->currentTemp)) zone->currentTemp = saved->currentTemp;
+        if (saved->targetState != CoolingState_Off) set_speed(zone, saved->speed);
+
+        Log(LOG_LEVEL_INFO, "%scheckpoint : %s at %.1f, fan at %.1f%%", zone->tag,
+            CoolingStateStr[saved->targetState], saved->targetTemp, zone->currentSpeed);
+    }
+    resumed = true;
+    Log(LOG_LEVEL_INFO, "checkpoint : resumed from %lds ago", (age > 0) ? age : 0);
+}
+
+// The saved filter state is only any use with the same stages
+//
+static bool filters_match(const FilterChain* chain, const Config* config)
+{
+    if (chain->stages != config->probeFilterStages || !FilterChainValid(chain)) {
+        return false;
+    }
+    for (int i = 0; i < chain->stages; i++) {
+        const FilterConfig* a = &chain->stage[i].config;
+        const FilterConfig* b = &config->probeFilter[i];
+        if (a->type != b->type || a->taps != b->taps || a->alpha != b->alpha) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// acquire thread reads the thermocouples on the loop period and queues
+// the readings for heartThread
+//
+void * acquireThread(void* arg)
+{
+    const Config* config = ConfigGet();
+    const int probeCount = boot.probeCount;
+    MAX6675 probes[STATE_MAX_PROBES] = { 0 };
+    unsigned long transfers[STATE_MAX_PROBES] = { 0 };
+
+    for (int i = 0; i < probeCount; i++) {
+        probes[i] = MAX6675Setup(boot.probeChannels[i]);
+        if (probes[i] == NULL) Log(LOG_LEVEL_WARN, "probe %d : SPI channel %d setup failed", i, boot.probeChannels[i]);
+    }
 
-    int prev_rpm = -1;
-    struct timeval prev_tach = currentTach;
+    Ticker ticker;
+    TickerStart(&ticker, config->refreshMs);
 
     while(!End) {
-        currentTemp = MAX6675GetTempC(max6675);
+        MetricObserve(&metrics.loopJitter, ticker.jitterNs);
+        MetricSet(&metrics.loopOverruns, ticker.overruns);
+
+        const Config* latest = ConfigGet();
+        if (latest != config) {
+            if (latest->refreshMs != config->refreshMs) {
+                TickerSetPeriod(&ticker, latest->refreshMs);
+            }
+            config = latest;
+        }
 
-        if(debug) printf("currentTemp:%0.2f,targetTemp:%0.2f, currentState:%s,targetState:%s\n",
-            currentTemp, targetTemp, 
-            currentState == CoolingState_Off?"OFF":"ON", 
-            targetState  == CoolingState_Off?"OFF":"ON");
+        Acquisition acq = {
+            .ns          = HalNow(),
+        };
+        MAX6675ReadAll(probes, probeCount, acq.readings);
 
-        if(currentState != targetState) {
-            currentState = targetState;
+        for (int i = 0; i < probeCount; i++) {
+            MetricInc(&metrics.probeReads[i][acq.readings[i].status]);
+            if (probes[i] && probes[i]->transfers != transfers[i]) {
+                transfers[i] = probes[i]->transfers;
+                MetricObserve(&metrics.spiRead, probes[i]->lastTransferNs);
+            }
         }
 
-        if(targetState == CoolingState_Off) {
-            set_speed(0);
+        if (!SpscPush(&acquired, &acq)) Log(LOG_LEVEL_WARN, "acquire : control thread behind, reading dropped");
+
+        TickerWait(&ticker);
+    }
+
+    // Let heartThread see End
+    SpscWake(&acquired);
+
+    for (int i = 0; i < probeCount; i++) {
+        MAX6675Free(probes[i]);
+    }
+    return arg;
+}
+
+// One control cycle of a zone on the filtered readings.  tune is the
+// autotune run when it belongs to this zone, NULL otherwise, and request
+// the start (> 0) or abort (< 0) asked for it this cycle.
+//
+static void zone_step(Zone* zone, int id, const Config* config, const MAX6675Reading* readings,
+    double now, double dt, Autotune* tune, int request)
+{
+    ControllerSettings* settings = &zone->settings;
+    unsigned int version = SeqLockRead(&settingsLocks[id], settings);
+    if (version != zone->settingsVersion) {
+        zone->settingsVersion = version;
+        ControllerSetGains(zone->controller, &settings->gains);
+        ControllerSetType(zone->controller, settings->type);
+        Log(LOG_LEVEL_INFO, "%scontroller : %s kp=%.3f ki=%.4f kd=%.3f kff=%.3f", zone->tag, ControllerName(settings->type),
+            settings->gains.kp, settings->gains.ki, settings->gains.kd, settings->gains.kff);
+    }
+
+    // A bad read keeps the last pit temperature, a probe that stays bad
+    // latches the fan off: 0 degrees from a dropped probe would look
+    // like a dying fire and run the fan flat out
+    const MAX6675Reading* pit = &readings[zone->controlProbe];
+    if (pit->status == MAX6675_OK) {
+        zone->currentTemp = pit->value;
+        zone->measured = true;
+        zone->badReads = 0;
+        if (zone->fault != MAX6675_OK && zone->rearmCount != zone->faultRearm) {
+            Log(LOG_LEVEL_INFO, "%sprobe fault cleared", zone->tag);
+            zone->fault = MAX6675_OK;
+        }
+    }
+    else if (++zone->badReads >= config->probeFaultReads && zone->fault == MAX6675_OK) {
+        zone->fault = pit->status;
+        zone->faultRearm = zone->rearmCount;
+        Log(LOG_LEVEL_WARN, "%sprobe fault : %s (raw 0x%04x), fan latched off", zone->tag, MAX6675StatusStr(zone->fault), pit->raw);
+    }
+
+    double override = atomic_exchange(&zone->overrideTemp, NAN);
+    if (!isnan(override)) {
+        zone->currentTemp = override;
+        zone->measured = true;
+    }
+
+    CoolingState target = zone->target = zone->targetState;
+    double setPoint = zone->setPoint = zone->targetTemp;
+    double currentTemp = zone->currentTemp;
+
+    Log(LOG_LEVEL_DEBUG, "%scurrentTemp:%0.2f,targetTemp:%0.2f, currentState:%s,targetState:%s", zone->tag,
+        currentTemp, setPoint,
+        zone->currentState == CoolingState_Off?"OFF":"ON",
+        target             == CoolingState_Off?"OFF":"ON");
+
+    if(zone->currentState != target) {
+        zone->currentState = target;
+    }
+    if (zone->fault != MAX6675_OK) {
+        zone->currentState = CoolingState_Off;
+    }
+
+    if (tune != NULL) {
+        if (request > 0 && tune->state != AUTOTUNE_RUNNING && zone->currentState != CoolingState_Off) {
+            AutotuneStart(tune, &config->autotune, setPoint, zone->controller->output);
+            Log(LOG_LEVEL_INFO, "%sautotune : started at %.1f, bias %.1f%%", zone->tag, setPoint, tune->bias);
+        }
+        else if (request < 0) {
+            AutotuneAbort(tune, "aborted");
+        }
+        else if (tune->state == AUTOTUNE_RUNNING && setPoint != tune->setPoint) {
+            AutotuneAbort(tune, "target changed");
+        }
+    }
+
+    if(target == CoolingState_Off || zone->fault != MAX6675_OK) {
+        // Restart from a stopped fan once switched back on
+        if (tune != NULL) AutotuneAbort(tune, "fan switched off");
+        ControllerReset(zone->controller, currentTemp, 0.0);
+        LidReset(&zone->lid);
+        zone->lidOpen = false;
+        set_speed(zone, 0);
+    }
+    else if (!zone->measured) {
+        // No pit reading since start up yet, hold the fan where the
+        // checkpoint left it rather than act on a stale temperature
+        set_speed(zone, zone->currentSpeed);
+    }
+    else if (tune != NULL && tune->state == AUTOTUNE_RUNNING) {
+        set_speed(zone, AutotuneStep(tune, currentTemp, dt));
+        if (tune->state == AUTOTUNE_DONE) {
+            autotune_done(tune, id, currentTemp);
+        }
+    }
+    else if (LidUpdate(&zone->lid, now, currentTemp, zone->currentSpeed)) {
+        // Freeze the controller, a fan stoking the fire now overshoots later
+        if (!zone->lidOpen) {
+            MetricInc(&metrics.lidEvents);
+            Log(LOG_LEVEL_INFO, "%slid open : %.1f below %.1f, fan held at %.1f%%", zone->tag,
+                zone->lid.peak - currentTemp, zone->lid.peak, zone->lid.hold);
+        }
+        zone->lidOpen = true;
+        set_speed(zone, zone->lid.hold);
+    }
+    else {
+        if (zone->lidOpen) {
+            Log(LOG_LEVEL_INFO, "%slid closed : pit at %.1f", zone->tag, currentTemp);
+            ControllerReset(zone->controller, currentTemp, zone->currentSpeed);
+            zone->lidOpen = false;
+        }
+
+        double out = ControllerStep(zone->controller, setPoint, currentTemp, dt);
+        double clamped = PlantClamp(&config->plant, settings->gains.ambient, setPoint, currentTemp, out);
+        if (clamped < out) {
+            ControllerTrack(zone->controller, clamped);
+        }
+        set_speed(zone, clamped);
+    }
+}
+
+// heart thread filters the readings and steps every zone's controller and fan
+//
+void * heartThread(void* arg)
+{
+    const Config* config = ConfigGet();
+    const int probeCount = boot.probeCount;
+    MAX6675Reading* readings;
+    FilterChain filters[STATE_MAX_PROBES];
+    Eta etas[STATE_MAX_PROBES];
+    MAX6675Status prevStatus[STATE_MAX_PROBES];
+    bool isPit[STATE_MAX_PROBES] = { false };
+
+    for (int i = 0; i < probeCount; i++) {
+        FilterChainSetup(&filters[i], config->probeFilter, config->probeFilterStages);
+        EtaSetup(&etas[i], &config->eta);
+        prevStatus[i] = MAX6675_OK;
+    }
+
+    for (int z = 0; z < zoneCount; z++) {
+        Zone* zone = &zones[z];
+
+        isPit[zone->controlProbe] = true;
+        zone->settingsVersion = SeqLockRead(&settingsLocks[z], &zone->settings);
+        zone->controller = ControllerSetup(zone->settings.type, &zone->settings.gains);
+        if (zone->controller == NULL) error("controller setup failed");
+        LidSetup(&zone->lid, &config->lid);
+
+        // Carry on with the integrator of the last run, or at least start
+        // bumpless from the fan speed it left
+        if (resumed && z < resume.zones) {
+            const CheckpointZone* saved = &resume.zone[z];
+            if (saved->controller == zone->settings.type && isfinite(saved->integral) && isfinite(saved->output)) {
+                ControllerRestore(zone->controller, saved->integral, saved->output);
+            }
+            else {
+                ControllerReset(zone->controller, zone->currentTemp, zone->currentSpeed);
+            }
+        }
+    }
+
+    if (resumed && resume.probes == probeCount) {
+        for (int i = 0; i < probeCount; i++) {
+            if (filters_match(&resume.filters[i], config)) filters[i] = resume.filters[i];
+        }
+    }
+
+    Checkpoint checkpoint = { .zones = zoneCount, .probes = probeCount };
+    CoolingState savedState[STATE_MAX_ZONES];
+    double savedTemp[STATE_MAX_ZONES];
+    for (int z = 0; z < zoneCount; z++) {
+        savedState[z] = zones[z].targetState;
+        savedTemp[z] = zones[z].targetTemp;
+    }
+
+    // The tach only watches the zone 0 fan
+    TachReading tach = { 0 };
+    bool prevStalled = false;
+    int prevRpm = -1;
+
+    Autotune tune = { .state = AUTOTUNE_IDLE };
+    AutotuneState prevTuneState = AUTOTUNE_IDLE;
+    int tuneZone = 0;
+    SeqLockWrite(&autotuneLock, &tune);
+
+    Acquisition acq;
+    uint64_t prevCycle = 0;
+
+    while(!End) {
+        SpscWait(&acquired);
+        if (!SpscPop(&acquired, &acq)) {
+            continue;
         }
-        else if (currentTemp > targetTemp) {
-            set_speed(0);
+
+        uint64_t cycleStart = MetricNow();
+        double dt = prevCycle ? (acq.ns - prevCycle) / 1e9 : config->refreshMs / 1000.0;
+        double now = acq.ns / 1e9;
+        prevCycle = acq.ns;
+        readings = acq.readings;
+
+        // Pick up a reloaded configuration, start up only settings stay as they were
+        const Config* latest = ConfigGet();
+        if (latest != config) {
+            if (latest->probeFilterStages != config->probeFilterStages
+                || memcmp(latest->probeFilter, config->probeFilter, sizeof(latest->probeFilter))) {
+                for (int i = 0; i < probeCount; i++) {
+                    FilterChainSetup(&filters[i], latest->probeFilter, latest->probeFilterStages);
+                }
+            }
+            TachConfig tachConfig;
+            tach_config(latest, &tachConfig);
+            TachConfigure(&tachConfig);
+            for (int z = 0; z < zoneCount; z++) {
+                FanConfigure(zones[z].fan, &latest->fan);
+                LidConfigure(&zones[z].lid, &latest->lid);
+            }
+            for (int i = 0; i < probeCount; i++) {
+                EtaConfigure(&etas[i], &latest->eta);
+            }
+            config = latest;
         }
-        else if (currentTemp < targetTemp-50) {
-            set_speed(100);
+
+        // Only good readings reach the filters, value is replaced by the filtered
+        // temperature.  A probe coming back starts from fresh history.
+        for (int i = 0; i < probeCount; i++) {
+            if (readings[i].status == MAX6675_OK) {
+                if (prevStatus[i] != MAX6675_OK) FilterChainReset(&filters[i]);
+                readings[i].value = FilterChainPush(&filters[i], readings[i].value);
+            }
+            prevStatus[i] = readings[i].status;
         }
-        else {
-            double left = ((targetTemp - currentTemp) * 100.0) / targetTemp;
-            if(left > 0.0) {
-                set_speed(left);
+
+        // A start moves autotune to another zone unless a run is still
+        // going, a request for any other zone is dropped
+        int request = atomic_exchange(&autotuneRequest, 0);
+        int requestZone = abs(request) - 1;
+        if (request != 0 && requestZone != tuneZone) {
+            if (request > 0 && requestZone < zoneCount && tune.state != AUTOTUNE_RUNNING) {
+                tuneZone = requestZone;
+                autotuneZone = tuneZone;
             }
             else {
-                set_speed(0);
+                request = 0;
             }
         }
 
-        if (!timercmp(&prev_tach, &currentTach, !=))
-        rpm = 0;
+        unsigned long writes = 0, held = 0;
+        for (int z = 0; z < zoneCount; z++) {
+            zone_step(&zones[z], z, config, readings, now, dt, (z == tuneZone) ? &tune : NULL, (z == tuneZone) ? request : 0);
+            writes += zones[z].fan->writes;
+            held += zones[z].fan->held;
+        }
+        MetricSet(&metrics.pwmWrites, writes);
+        MetricSet(&metrics.pwmHeld, held);
+
+        // Handed over every cycle, written in batches unless a set point changed
+        bool urgent = false;
+        for (int z = 0; z < zoneCount; z++) {
+            const Zone* zone = &zones[z];
+            CheckpointZone* saved = &checkpoint.zone[z];
+
+            urgent = urgent || zone->target != savedState[z] || zone->setPoint != savedTemp[z];
+            savedState[z] = zone->target;
+            savedTemp[z] = zone->setPoint;
+
+            saved->targetState = zone->target;
+            saved->controller  = zone->controller->type;
+            saved->targetTemp  = zone->setPoint;
+            saved->currentTemp = zone->currentTemp;
+            saved->integral    = zone->controller->integral;
+            saved->output      = zone->controller->output;
+            saved->speed       = zone->currentSpeed;
+        }
+        memcpy(checkpoint.filters, filters, sizeof(FilterChain) * probeCount);
+        CheckpointSave(&checkpoint, urgent);
+
+        Zone* tuned = &zones[tuneZone];
+        if (tune.state == AUTOTUNE_FAILED && prevTuneState == AUTOTUNE_RUNNING) {
+            Log(LOG_LEVEL_WARN, "%sautotune : failed, %s", tuned->tag, tune.reason);
+            ControllerReset(tuned->controller, tuned->currentTemp, tuned->currentSpeed);
+        }
+        prevTuneState = tune.state;
+        SeqLockWrite(&autotuneLock, &tune);
+
+        Zone* first = &zones[0];
+        TachUpdate(first->currentSpeed, &tach);
+        MetricSet(&metrics.tachEdges, tach.edges);
+        MetricSet(&metrics.tachBounced, tach.bounced);
+        MetricSet(&metrics.tachDropped, tach.dropped);
+        MetricSet(&metrics.logDropped, LogDropped());
+        MetricSet(&metrics.logLimited, LogLimited());
+
+        if (prevRpm != (int)tach.rpm) Log(LOG_LEVEL_DEBUG, "rpm : %d", (int)tach.rpm);
+        if (tach.stalled && !prevStalled) {
+            Log(LOG_LEVEL_WARN, "fan stalled at %.1f%% duty", first->currentSpeed);
+            FanKick(first->fan);
+        }
+
+        prevRpm = tach.rpm;
+        prevStalled = tach.stalled;
 
-        if (debug && prev_rpm != rpm) printf("rpm : %d\n", rpm);
+        // The probes are the same in every zone's snapshot, every probe
+        // that is no zone's pit is a meat probe cooking in zone 0
+        BBQState snapshot = {
+            .probeCount   = probeCount,
+        };
+        for (int i = 0; i < probeCount; i++) {
+            snapshot.probeTemps[i]  = readings[i].value;
+            snapshot.probeStatus[i] = readings[i].status;
+            snapshot.etaSeconds[i]  = -1.0;
 
-        prev_rpm = rpm;
-        prev_tach = currentTach;
+            if (!isPit[i]) {
+                if (readings[i].status == MAX6675_OK) EtaPush(&etas[i], readings[i].value, first->currentTemp, dt);
+                snapshot.etaSeconds[i]   = etas[i].seconds;
+                snapshot.probeStalled[i] = etas[i].stalled;
+            }
+        }
+        for (int z = 0; z < zoneCount; z++) {
+            const Zone* zone = &zones[z];
+
+            snapshot.targetState  = zone->target;
+            snapshot.targetTemp   = zone->setPoint;
+            snapshot.currentState = zone->currentState;
+            snapshot.currentTemp  = zone->currentTemp;
+            snapshot.fault        = zone->fault;
+            snapshot.speed        = zone->currentSpeed;
+            snapshot.rpm          = (z == 0) ? tach.rpm : 0;
+            snapshot.fanStalled   = (z == 0) ? tach.stalled : 0;
+            snapshot.lidOpen      = zone->lidOpen;
+            snapshot.controller   = zone->controller->type;
+            snapshot.pidP         = zone->controller->p;
+            snapshot.pidI         = zone->controller->i;
+            snapshot.pidD         = zone->controller->d;
+            snapshot.pidFF        = zone->controller->ff;
+            StatePublishZone(z, &snapshot);
+            if (z == 0) StatusUpdate(&snapshot);
+        }
+        EventsNotify();
+        MqttNotify();
+
+        float temps[STATE_MAX_PROBES];
+        for (int i = 0; i < probeCount; i++) {
+            temps[i] = (readings[i].status == MAX6675_OK) ? readings[i].value : NAN;
+        }
+        HistoryRecord(HalTime(), temps, first->setPoint, first->currentSpeed, tach.rpm);
 
-        usleep(1000000);
+        MetricObserve(&metrics.loopDuration, MetricNow() - cycleStart);
     }
 
-    MAX6675Free(max6675);
+    CookLogClose();
+    TachStop();
+    for (int z = 0; z < zoneCount; z++) {
+        FanFree(zones[z].fan);
+        ControllerFree(zones[z].controller);
+    }
 
     return arg;
 }
 
 int parse_qs (void *arg, enum MHD_ValueKind kind, const char *key, const char *val)
 {
-    int* valu = arg;
+    double* value = arg;
+    char* end;
 
-    if(!strcmp(key, "value")) {
-        *valu = atoi(val);
+    if(!strcmp(key, "value") && val != NULL) {
+        double v = strtod(val, &end);
+        if (end != val && isfinite(v)) {
+            *value = v;
+        }
     }
     return MHD_YES;
 }
 
-static int qs_proc (void *cls,
+int parse_gains (void *arg, enum MHD_ValueKind kind, const char *key, const char *val)
+{
+    ControllerGains* gains = arg;
+    char* end;
+
+    if (val == NULL) {
+        return MHD_YES;
+    }
+
+    double v = strtod(val, &end);
+    if (end == val || isnan(v) || v < 0.0) {
+        return MHD_YES;
+    }
+
+    if (!strcmp(key, "kp"))           gains->kp = v;
+    else if (!strcmp(key, "ki"))      gains->ki = v;
+    else if (!strcmp(key, "kd"))      gains->kd = v;
+    else if (!strcmp(key, "kff"))     gains->kff = v;
+    else if (!strcmp(key, "ambient")) gains->ambient = v;
+    return MHD_YES;
+}
+
+// Apply a controller change from an HTTP handler and reply with the result
+//
+static int controller_proc(struct MHD_Connection* conn, int zone, const char* url, int valu)
+{
+    ControllerSettings settings;
+
+    pthread_mutex_lock(&settingsWriteLock);
+    SeqLockRead(&settingsLocks[zone], &settings);
+    if (!strcmp(url, "/controllerGains")) {
+        MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND, parse_gains, &settings.gains);
+    }
+    else if (valu >= 0 && valu < CONTROLLER_COUNT) {
+        settings.type = valu;
+    }
+    SeqLockWrite(&settingsLocks[zone], &settings);
+    pthread_mutex_unlock(&settingsWriteLock);
+
+    char body[256];
+    int len = snprintf(body, sizeof(body),
+        "{\"controller\": \"%s\",\"kp\": %.4f,\"ki\": %.5f,\"kd\": %.4f,\"kff\": %.4f,\"ambient\": %.2f}",
+        ControllerName(settings.type), settings.gains.kp, settings.gains.ki,
+        settings.gains.kd, settings.gains.kff, settings.gains.ambient);
+
+    return StatusQueueBody(conn, body, len);
+}
+
+// /autotune?value=<1 start|0 abort>, reports the state of the last run
+// either way, whichever zone it was on
+//
+static int autotune_proc(struct MHD_Connection* conn, int zone, int valu)
+{
+    if (valu == 1) {
+        autotuneRequest = zone + 1;
+    }
+    else if (valu == 0) {
+        autotuneRequest = -(zone + 1);
+    }
+
+    Autotune tune;
+    SeqLockRead(&autotuneLock, &tune);
+
+    char body[400];
+    int len = snprintf(body, sizeof(body),
+        "{\"zone\": %d,\"state\": \"%s\",\"reason\": \"%s\",\"elapsed\": %.0f,\"cycles\": %d,\"ku\": %.4f,\"tu\": %.1f,\"kp\": %.4f,\"ki\": %.6f,\"kd\": %.4f}",
+        (int)autotuneZone, AutotuneStateStr(tune.state), tune.reason ? tune.reason : "", tune.elapsed, (tune.seen > 1) ? tune.seen - 1 : 0,
+        tune.ku, tune.tu, tune.gains.kp, tune.gains.ki, tune.gains.kd);
+
+    return StatusQueueBody(conn, body, len);
+}
+
+// /history?since=<cursor>&res=<1|10|60>, samples recorded after cursor
+//
+static int history_proc(struct MHD_Connection* conn)
+{
+    const char* res = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "res");
+    const char* since = MHD_lookup_connection_value(conn, MHD_GET_ARGUMENT_KIND, "since");
+
+    int tier = HistoryTier(res ? atoi(res) : 1);
+    if (tier < 0) {
+        return StatusQueueError(conn, MHD_HTTP_BAD_REQUEST, "res must be 1, 10 or 60");
+    }
+
+    size_t len;
+    char* body = HistoryRender(tier, since ? strtoul(since, NULL, 10) : 0, &len);
+    if (body == NULL) {
+        return MHD_NO;
+    }
+    return StatusQueueOwned(conn, body, len);
+}
+
+// POST body collected across access handler calls, freed once the
+// request completes
+//
+#define UPLOAD_MAX 4096
+
+#ifndef MHD_HTTP_PAYLOAD_TOO_LARGE
+#define MHD_HTTP_PAYLOAD_TOO_LARGE MHD_HTTP_REQUEST_ENTITY_TOO_LARGE   // name before 0.9.68
+#endif
+
+typedef struct Upload {
+    size_t  len;
+    bool    tooLarge;
+    char    data[UPLOAD_MAX + 1];
+} Upload;
+
+#define V2_TEMP_MIN -40.0
+#define V2_TEMP_MAX 500.0
+
+// Fields of a /v2/state write, absent ones stay NAN / -1
+//
+typedef struct StateCommand {
+    double          targetTemp;
+    int             targetState;
+    double          currentTemp;
+    int             controller;
+    ControllerGains gains;
+    const char*     error;
+} StateCommand;
+
+// The one check for a requested mode, shared by /v2/state and the v1 route
+//
+static bool valid_target_state(double v)
+{
+    return v == floor(v) && v >= CoolingState_Off && v <= CoolingState_Auto;
+}
+
+static bool state_gain(StateCommand* cmd, const char* key, double v)
+{
+    double* gain = NULL;
+
+    if (!strcmp(key, "kp"))           gain = &cmd->gains.kp;
+    else if (!strcmp(key, "ki"))      gain = &cmd->gains.ki;
+    else if (!strcmp(key, "kd"))      gain = &cmd->gains.kd;
+    else if (!strcmp(key, "kff"))     gain = &cmd->gains.kff;
+    else if (!strcmp(key, "ambient")) gain = &cmd->gains.ambient;
+
+    if (gain == NULL) {
+        cmd->error = "unknown field";
+        return false;
+    }
+    if (v < 0.0) {
+        cmd->error = "gains must not be negative";
+        return false;
+    }
+    *gain = v;
+    return true;
+}
+
+static bool state_field(void* arg, const char* key, const JsonValue* value)
+{
+    StateCommand* cmd = arg;
+
+    if (!strcmp(key, "controller")) {
+        for (int t = 0; value->type == JSON_STRING && t < CONTROLLER_COUNT; t++) {
+            if (!strcmp(value->string, ControllerName(t))) {
+                cmd->controller = t;
+                return true;
+            }
+        }
+        cmd->error = "unknown controller";
+        return false;
+    }
+
+    if (value->type != JSON_NUMBER || !isfinite(value->number)) {
+        cmd->error = "expected a number";
+        return false;
+    }
+    double v = value->number;
+
+    if (!strcmp(key, "targetTemperature") || !strcmp(key, "currentTemperature")) {
+        if (v < V2_TEMP_MIN || v > V2_TEMP_MAX) {
+            cmd->error = "temperature out of range";
+            return false;
+        }
+        if (key[0] == 't') cmd->targetTemp = v;
+        else               cmd->currentTemp = v;
+        return true;
+    }
+
+    if (!strcmp(key, "targetHeatingCoolingState")) {
+        if (!valid_target_state(v)) {
+            cmd->error = "targetHeatingCoolingState must be 0-3";
+            return false;
+        }
+        cmd->targetState = (int)v;
+        return true;
+    }
+
+    return state_gain(cmd, strncmp(key, "gains.", 6) ? key : key + 6, v);
+}
+
+// Applies every field of a JSON command object to a zone or, if any is
+// invalid, none of them.  state is the zone's snapshot patched with what
+// was just set.  Shared by POST /v2/state and the MQTT command topics.
+//
+static bool apply_command(int zone, const char* json, size_t len, BBQState* state, const char** error)
+{
+    Zone* z = &zones[zone];
+    StateCommand cmd = {
+        .targetTemp = NAN, .targetState = -1, .currentTemp = NAN, .controller = -1,
+        .gains = { NAN, NAN, NAN, NAN, NAN },
+    };
+
+    if (JsonParse(json, len, state_field, &cmd, error) < 0) {
+        if (cmd.error) *error = cmd.error;
+        return false;
+    }
+
+    // Validated, now apply.  Gains merge into the live settings under the
+    // write lock so a concurrent /controllerGains isn't lost
+    const ControllerGains* g = &cmd.gains;
+    if (cmd.controller >= 0 || !isnan(g->kp) || !isnan(g->ki) || !isnan(g->kd) || !isnan(g->kff) || !isnan(g->ambient)) {
+        ControllerSettings settings;
+
+        pthread_mutex_lock(&settingsWriteLock);
+        SeqLockRead(&settingsLocks[zone], &settings);
+        if (cmd.controller >= 0) settings.type = cmd.controller;
+        if (!isnan(g->kp))       settings.gains.kp = g->kp;
+        if (!isnan(g->ki))       settings.gains.ki = g->ki;
+        if (!isnan(g->kd))       settings.gains.kd = g->kd;
+        if (!isnan(g->kff))      settings.gains.kff = g->kff;
+        if (!isnan(g->ambient))  settings.gains.ambient = g->ambient;
+        SeqLockWrite(&settingsLocks[zone], &settings);
+        pthread_mutex_unlock(&settingsWriteLock);
+    }
+
+    StateReadZone(zone, state);
+
+    // The snapshot lags a set by up to one cycle, report what was just requested
+    if (!isnan(cmd.targetTemp)) {
+        z->targetTemp = cmd.targetTemp;
+        state->targetTemp = cmd.targetTemp;
+    }
+    if (cmd.targetState >= 0) {
+        z->targetState = cmd.targetState;
+        state->targetState = cmd.targetState;
+        z->rearmCount++;
+    }
+    if (!isnan(cmd.currentTemp)) {
+        z->overrideTemp = cmd.currentTemp;
+        state->currentTemp = cmd.currentTemp;
+    }
+    if (cmd.controller >= 0) {
+        state->controller = cmd.controller;
+    }
+    return true;
+}
+
+// MQTT follows zone 0
+//
+static bool mqtt_command(const char* json, size_t len, const char** error)
+{
+    BBQState state;
+
+    return apply_command(0, json, len, &state, error);
+}
+
+// /v2/state, GET is the snapshot, cached with ETag revalidation for zone
+// 0, POST takes a command object
+//
+static int v2_state_proc(struct MHD_Connection* conn, int zone, const char* method, Upload* upload)
+{
+    BBQState state;
+    const char* error = NULL;
+
+    if (!strcmp(method, MHD_HTTP_METHOD_GET)) {
+        if (zone == 0 && StatusQueueConditional(conn) == MHD_YES) {
+            return MHD_YES;
+        }
+        StateReadZone(zone, &state);
+        return StatusQueueState(conn, &state);
+    }
+
+    if (strcmp(method, MHD_HTTP_METHOD_POST) || upload == NULL) {
+        return StatusQueueError(conn, MHD_HTTP_METHOD_NOT_ALLOWED, "use GET or POST");
+    }
+    if (upload->tooLarge) {
+        return StatusQueueError(conn, MHD_HTTP_PAYLOAD_TOO_LARGE, "body too large");
+    }
+
+    upload->data[upload->len] = '\0';
+    if (!apply_command(zone, upload->data, upload->len, &state, &error)) {
+        return StatusQueueError(conn, MHD_HTTP_BAD_REQUEST, error);
+    }
+    return StatusQueueState(conn, &state);
+}
+
+// /zones, the status of every zone as an array in zone order
+//
+static int zones_proc(struct MHD_Connection* conn)
+{
+    char body[1024 * STATE_MAX_ZONES + 8];
+    size_t len = 0;
+    bool ok = StatusAppend(body, sizeof(body), &len, "[");
+
+    for (int i = 0; ok && i < zoneCount; i++) {
+        BBQState state;
+        StateReadZone(i, &state);
+        ok = StatusAppend(body, sizeof(body), &len, i ? "," : "");
+        int n = ok ? StatusRender(body + len, sizeof(body) - len, &state) : 0;
+        ok = ok && n > 0 && (size_t)n < sizeof(body) - len;
+        len += ok ? n : 0;
+    }
+    if (!ok || !StatusAppend(body, sizeof(body), &len, "]")) {
+        return MHD_NO;
+    }
+    return StatusQueueBody(conn, body, len);
+}
+
+// Zone of a /zones/<id>/<endpoint> url, with url moved on to the
+// endpoint.  /zones/<id> alone is its /status.  Other urls are zone 0 and
+// stay as they are, -1 for a zone that doesn't exist.
+//
+static int zone_for(const char** url)
+{
+    const char* p = *url;
+    char* end;
+
+    if (strncmp(p, "/zones/", 7)) {
+        return 0;
+    }
+
+    long id = strtol(p + 7, &end, 10);
+    if (end == p + 7 || id < 0 || id >= zoneCount || (*end != '/' && *end != '\0')) {
+        return -1;
+    }
+    *url = (*end == '\0') ? "/status" : end;
+    return (int)id;
+}
+
+static int route (void *cls,
     struct MHD_Connection*        conn,
     const char*                    url,
     const char*                 method,
@@ -233,67 +1161,283 @@ static int qs_proc (void *cls,
     size_t*           upload_data_size, 
     void **                        ptr)
 {
-    struct MHD_Response *res = NULL;
-
     if(url == NULL) {
         return MHD_NO;
     }
 
-    int valu=INT_MIN;
-    MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND, parse_qs, &valu);
+    if (!strcmp(url, "/zones")) {
+        return zones_proc(conn);
+    }
+
+    int zone = zone_for(&url);
+    if (zone < 0) {
+        return StatusQueueError(conn, MHD_HTTP_NOT_FOUND, "no such zone");
+    }
 
-    char* body = NULL;
     if (!strcmp(url, "/status")) {
-        asprintf(&body, "{\"targetHeatingCoolingState\": %d,\"targetTemperature\": %.2f,\"currentHeatingCoolingState\": %d,\"currentTemperature\": %.2f}", 
-            targetState, targetTemp,
-            currentState, currentTemp);
+        // Cached response, nothing is formatted or allocated here
+        if (zone == 0 && StatusQueue(conn) == MHD_YES) {
+            return MHD_YES;
+        }
+        BBQState state;
+        StateReadZone(zone, &state);
+        return StatusQueueState(conn, &state);
+    }
+
+    // The rest of the daemon only exists once, not per zone
+    if (zone > 0 && (!strcmp(url, "/metrics") || !strcmp(url, "/events") || !strcmp(url, "/history"))) {
+        return StatusQueueError(conn, MHD_HTTP_NOT_FOUND, "not per zone");
+    }
+
+    if (!strcmp(url, "/metrics")) {
+        return MetricsQueue(conn);
+    }
+
+    if (!strcmp(url, "/events")) {
+        return EventsQueue(conn);
+    }
+
+    if (!strcmp(url, "/history")) {
+        return history_proc(conn);
+    }
+
+    if (!strcmp(url, "/v2/state")) {
+        return v2_state_proc(conn, zone, method, *ptr);
+    }
+
+    double value = NAN;
+    MHD_get_connection_values (conn, MHD_GET_ARGUMENT_KIND, parse_qs, &value);
+    int valu = (isnan(value) || fabs(value) > INT_MAX) ? INT_MIN : (int)value;
+
+    if (!strcmp(url, "/autotune")) {
+        return autotune_proc(conn, zone, valu);
+    }
+
+    if (!strcmp(url, "/controllerGains") || (!strcmp(url, "/controller") && valu != INT_MIN)) {
+        return controller_proc(conn, zone, url, valu);
+    }
+
+    if(isnan(value)) {
+        return MHD_NO;
     }
-    else if(valu != INT_MIN) {
-        if (!strcmp(url, "/targetTemperature")) {
-            targetTemp = valu;
-            body = calloc(1, 1);
+
+    Zone* z = &zones[zone];
+    BBQState state;
+    StateReadZone(zone, &state);
+
+    // The snapshot lags a set by up to one cycle, report what was just requested
+    if (!strcmp(url, "/targetTemperature")) {
+        z->targetTemp = value;
+        state.targetTemp = value;
+    }
+    else if(!strcmp(url, "/targetHeatingCoolingState")) {
+        if (!valid_target_state(value)) {
+            return StatusQueueError(conn, MHD_HTTP_BAD_REQUEST, "targetHeatingCoolingState must be 0-3");
         }
-        else if(!strcmp(url, "/targetHeatingCoolingState")) {
-            targetState = valu;
-            body = calloc(1, 1);
+        z->targetState = valu;
+        state.targetState = valu;
+        z->rearmCount++;
+    }
+    // /currentTempreture is the original misspelling, kept for old clients
+    else if(!strcmp(url, "/currentTemperature") || !strcmp(url, "/currentTempreture")) {
+        z->overrideTemp = value;
+        state.currentTemp = value;
+    }
+
+    return StatusQueueState(conn, &state);
+}
+
+// Access handler, counts and times every request before routing it
+//
+static int qs_proc (void *cls,
+    struct MHD_Connection*        conn,
+    const char*                    url,
+    const char*                 method,
+    const char*                version,
+    const char*            upload_data,
+    size_t*           upload_data_size,
+    void **                        ptr)
+{
+    // A POST body arrives over several calls, buffer it and route on the
+    // last one, which is also the only one counted
+    if (method && !strcmp(method, MHD_HTTP_METHOD_POST)) {
+        Upload* upload = *ptr;
+
+        if (upload == NULL) {
+            if ((upload = calloc(1, sizeof(Upload))) == NULL) {
+                return MHD_NO;
+            }
+            *ptr = upload;
+            return MHD_YES;
         }
-        else if(!strcmp(url, "/currentTempreture")) {
-            currentTemp = valu;
-            body = calloc(1, 1);
+
+        if (*upload_data_size != 0) {
+            if (upload->len + *upload_data_size > UPLOAD_MAX) {
+                upload->tooLarge = true;
+            }
+            else {
+                memcpy(upload->data + upload->len, upload_data, *upload_data_size);
+                upload->len += *upload_data_size;
+            }
+            *upload_data_size = 0;
+            return MHD_YES;
         }
-        asprintf(&body, "{\"targetHeatingCoolingState\": %d,\"targetTemperature\": %.2f,\"currentHeatingCoolingState\": %d,\"currentTemperature\": %.2f}", 
-            targetState, targetTemp,
-            currentState, currentTemp);
     }
 
-    if(body == NULL) {
-        return MHD_NO;
-    }
+    uint64_t start = MetricNow();
+    MetricPath path = url ? MetricPathFor(url) : METRIC_PATH_OTHER;
 
-    res = MHD_create_response_from_buffer(strlen(body), body,  MHD_RESPMEM_MUST_FREE);
-    MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, "application/json");
-    MHD_add_response_header(res, "Connection", "close");
+    int ret = route(cls, conn, url, method, version, upload_data, upload_data_size, ptr);
 
-    int ret = MHD_queue_response (conn, MHD_HTTP_OK, res);
-    MHD_destroy_response (res);
+    MetricInc(&metrics.httpRequests[path]);
+    MetricObserve(&metrics.httpLatency[path], MetricNow() - start);
     return ret;
 }
 
-int main (void)
+// Frees the POST body buffered by qs_proc, if any
+//
+static void request_completed(void* cls, struct MHD_Connection* conn, void** ptr, enum MHD_RequestTerminationCode toe)
+{
+    free(*ptr);
+    *ptr = NULL;
+}
+
+// Start the HTTP daemon in the configured server mode
+//
+struct MHD_Daemon* start_daemon(void)
+{
+    unsigned int timeout = boot.keepAlive ? boot.connectionTimeout : 0;
+
+    if (boot.serverMode == ServerMode_Epoll) {
+        unsigned int pool = (boot.threadPoolSize > 1) ? boot.threadPoolSize : 1;
+        EventsSetup(true, boot.eventsMaxClients);
+        struct MHD_Daemon* d = MHD_start_daemon (  MHD_USE_EPOLL_INTERNAL_THREAD
+                                                | MHD_ALLOW_SUSPEND_RESUME
+                                                | MHD_USE_DEBUG,
+                                                boot.bindPort, NULL, NULL, &qs_proc, 0,
+                                                MHD_OPTION_THREAD_POOL_SIZE, pool,
+                                                MHD_OPTION_CONNECTION_TIMEOUT, timeout,
+                                                MHD_OPTION_NOTIFY_COMPLETED, request_completed, NULL,
+                                                MHD_OPTION_END);
+        if (d != NULL) {
+            Log(LOG_LEVEL_DEBUG, "http : epoll mode, %u worker(s), keep-alive %s", pool, boot.keepAlive ? "on" : "off");
+            return d;
+        }
+        // epoll is Linux only, fall back rather than run without an API
+        Log(LOG_LEVEL_WARN, "epoll daemon failed to start, falling back to thread per connection");
+    }
+
+    // Each /events client has its own thread to block in, no suspending needed
+    EventsSetup(false, boot.eventsMaxClients);
+    Log(LOG_LEVEL_DEBUG, "http : thread per connection mode, keep-alive %s", boot.keepAlive ? "on" : "off");
+    return MHD_start_daemon (  MHD_USE_THREAD_PER_CONNECTION
+                            | MHD_USE_INTERNAL_POLLING_THREAD
+                            | MHD_USE_DEBUG,
+                            boot.bindPort, NULL, NULL, &qs_proc, 0,
+                            MHD_OPTION_CONNECTION_TIMEOUT, timeout,
+                            MHD_OPTION_NOTIFY_COMPLETED, request_completed, NULL,
+                            MHD_OPTION_END);
+}
+
+// Re-read the configuration file on SIGHUP.  Controller settings only
+// change when the file changed them, so a reload doesn't undo a
+// /controller or /controllerGains write.  Returns on SIGINT or SIGTERM
+//
+static void reload_loop(const sigset_t* signals)
+{
+    int sig;
+    while (sigwait(signals, &sig) == 0) {
+        if (sig != SIGHUP) {
+            return;
+        }
+
+        ZoneConfig prev[STATE_MAX_ZONES];
+        memcpy(prev, ConfigGet()->zones, sizeof(prev));
+
+        if (ConfigReload() != 0) {
+            continue;
+        }
+
+        const Config* config = ConfigGet();
+        for (int i = 0; i < zoneCount; i++) {
+            const ZoneConfig* zone = &config->zones[i];
+            if (zone->controllerType != prev[i].controllerType
+                || memcmp(&zone->controllerGains, &prev[i].controllerGains, sizeof(prev[i].controllerGains))) {
+                ControllerSettings settings = { zone->controllerType, zone->controllerGains };
+                pthread_mutex_lock(&settingsWriteLock);
+                SeqLockWrite(&settingsLocks[i], &settings);
+                pthread_mutex_unlock(&settingsWriteLock);
+            }
+        }
+        LogConfigure(config->logLevel, config->logRate);
+        Log(LOG_LEVEL_INFO, "config : reloaded");
+    }
+}
+
+int main (int argc, char** argv)
 {
-    // shutdown interrupts
-    signal(SIGINT, shutdownTrap);
-    signal(SIGTERM, shutdownTrap);
+    const char* configPath = (argc > 1) ? argv[1] : CONFIG_DEFAULT_PATH;
+
+    // Before any thread, they all share the one writer
+    LogSetup(LOG_LEVEL_INFO, 0);
+    if (ConfigSetup(configPath) != 0) {
+        Log(LOG_LEVEL_ERROR, "Error : can't load %s", configPath);
+        LogClose();
+        return 1;
+    }
+    boot = *ConfigGet();
+    LogConfigure(boot.logLevel, boot.logRate);
+
+    // SIGHUP, SIGINT and SIGTERM are only taken by reload_loop, block
+    // them before any thread starts so they all inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
 
     // Start up the heartbeat thead which reads the therocouple and spins the fan.
     //
-    pthread_create(&heartTid, NULL, heartThread, NULL);
+    StatusSetup(boot.keepAlive);
+
+    setup_zones();
+
+    if (boot.rtLockMemory) RtLockMemory();
+
+    // Everything but the acquisition and control threads stays off their
+    // cores, including what wiringPi and the cook log start below
+    const int rtCpus[] = { boot.rtAcquireCpu, boot.rtControlCpu };
+    RtAvoidCpus(rtCpus, sizeof(rtCpus) / sizeof(rtCpus[0]));
+
+    // The fan is back on before the cook log, MQTT or HTTP start
+    setup_gpio();
+    restore_checkpoint();
+
+    HistorySetup(boot.probeCount);
+    if (boot.cookLogPath[0] && CookLogSetup(boot.cookLogPath, boot.cookLogFlushS) == 0) {
+        Log(LOG_LEVEL_INFO, "cook log : %s, %u samples restored", boot.cookLogPath, HistoryCursor(0));
+    }
+    if (boot.checkpointPath[0] && CheckpointSetup(boot.checkpointPath, boot.checkpointIntervalS) != 0) {
+        Log(LOG_LEVEL_WARN, "checkpoint : writer failed to start, state won't survive a restart");
+    }
+
+    MqttSetup(&boot.mqtt, mqtt_command);
+
+    if (SpscSetup(&acquired) != 0 || SpscSetup(&gainsToSave) != 0) error("can't set up the control queues");
+    if (pthread_create(&saveTid, NULL, saveThread, NULL) != 0) error("can't start the config writer");
+    if (RtThreadStart(&heartTid, "bbq-control", heartThread, NULL, boot.rtControlPriority, boot.rtControlCpu) != 0
+        || RtThreadStart(&acquireTid, "bbq-acquire", acquireThread, NULL, boot.rtAcquirePriority, boot.rtAcquireCpu) != 0) {
+        error("can't start the control threads");
+    }
+
+    struct MHD_Daemon* d = start_daemon();
+    if (d == NULL) {
+        Log(LOG_LEVEL_ERROR, "Error : failed to start HTTP daemon on port %d", boot.bindPort);
+    }
 
-    struct MHD_Daemon* d = MHD_start_daemon (  MHD_USE_THREAD_PER_CONNECTION
-                                            | MHD_USE_INTERNAL_POLLING_THREAD
-                                            | MHD_USE_DEBUG,
-                                            bindPort, NULL, NULL, &qs_proc, 0, MHD_OPTION_END);
-    pthread_join(heartTid, NULL);
+    reload_loop(&signals);
+    shut_down(d);
 
     if (d == NULL) {
         return 1;
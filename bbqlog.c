@@ -0,0 +1,108 @@
+/* Export a bbq cook log as CSV or JSON */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cooklog.h"
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-j] <cook.log>\n  -j  JSON instead of CSV\n", name);
+}
+
+static void print_temp(float t, const char* sep)
+{
+    if (isnan(t)) printf("%s%s", sep, "");
+    else printf("%s%.2f", sep, t);
+}
+
+static void print_json_temp(float t, const char* sep)
+{
+    if (isnan(t)) printf("%snull", sep);
+    else printf("%s%.2f", sep, t);
+}
+
+int main(int argc, char** argv)
+{
+    int json = 0;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j")) json = 1;
+        else if (path == NULL) path = argv[i];
+        else { usage(argv[0]); return 2; }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CookLogHeader)) {
+        fprintf(stderr, "%s: can't read %s\n", argv[0], path);
+        return 1;
+    }
+
+    const char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    const CookLogHeader* header = (const CookLogHeader*)map;
+    if (memcmp(header->magic, COOKLOG_MAGIC, sizeof(header->magic))
+        || header->version != COOKLOG_VERSION
+        || header->recordSize != sizeof(HistorySample)) {
+        fprintf(stderr, "%s: %s is not a compatible cook log\n", argv[0], path);
+        return 1;
+    }
+
+    int probes = (header->probes > STATE_MAX_PROBES) ? STATE_MAX_PROBES : header->probes;
+    long count = (st.st_size - sizeof(CookLogHeader)) / sizeof(HistorySample);
+    const HistorySample* samples = (const HistorySample*)(map + sizeof(CookLogHeader));
+
+    if (json) printf("{\"probes\": %d,\"samples\": [\n", probes);
+    else {
+        printf("time,target,duty,rpm");
+        for (int p = 0; p < probes; p++) printf(",probe%d_min,probe%d_max,probe%d_avg", p, p, p);
+        printf("\n");
+    }
+
+    for (long i = 0; i < count; i++) {
+        const HistorySample* s = &samples[i];
+
+        if (json) {
+            printf("%s{\"time\": %u,\"target\": %.2f,\"duty\": %.1f,\"rpm\": %.0f,\"probes\": [",
+                i ? ",\n" : "", s->time, s->target, s->duty, s->rpm);
+            for (int p = 0; p < probes; p++) {
+                printf("%s{", p ? "," : "");
+                print_json_temp(s->tempMin[p], "\"min\": ");
+                print_json_temp(s->tempMax[p], ",\"max\": ");
+                print_json_temp(s->tempAvg[p], ",\"avg\": ");
+                printf("}");
+            }
+            printf("]}");
+        }
+        else {
+            printf("%u,%.2f,%.1f,%.0f", s->time, s->target, s->duty, s->rpm);
+            for (int p = 0; p < probes; p++) {
+                print_temp(s->tempMin[p], ",");
+                print_temp(s->tempMax[p], ",");
+                print_temp(s->tempAvg[p], ",");
+            }
+            printf("\n");
+        }
+    }
+
+    if (json) printf("\n]}\n");
+
+    munmap((void*)map, st.st_size);
+    return 0;
+}
@@ -0,0 +1,254 @@
+/* Run the control loop against the simulated smoker for many cooks and compare controller set ups */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MAX6675.h"
+#include "config.h"
+#include "controller.h"
+#include "fan.h"
+#include "filter.h"
+#include "hal.h"
+#include "lid.h"
+#include "log.h"
+#include "plant.h"
+#include "pwmclock.h"
+#include "ticker.h"
+
+#define SETTLE_HOLD_S 600   // in band this long counts as settled
+
+typedef struct Options {
+    int     cooks;
+    double  hours;
+    double  target;
+    double  band;
+    unsigned int seed;
+} Options;
+
+// Outcome of one cook, temperatures are the model pit rather than the probe
+//
+typedef struct Cook {
+    double  overshoot;      // highest pit above target
+    double  settleS;        // first time in band for SETTLE_HOLD_S, < 0 if never
+    double  writesPerHour;  // PWM register writes
+    double  inBand;         // fraction of the time after settling within band
+    double  mae;            // mean absolute error after settling
+    unsigned long lidEvents;
+} Cook;
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [-n cooks] [-H hours] [-t target] [-b band] [-s seed] [config ...]\n"
+        "  every config file is one variant, built in defaults without any\n", name);
+}
+
+// Deterministic 0-1 value for the k'th random choice of a cook
+//
+static double draw(unsigned int seed, unsigned int k)
+{
+    unsigned int x = (seed + 1) * 2654435761u ^ (k + 1) * 40503u;
+
+    x ^= x >> 15;
+    x *= 2246822519u;
+    x ^= x >> 13;
+    return (x >> 8) / 16777216.0;
+}
+
+// One cook of zone 0, the pit probe through the same filter, lid, controller,
+// plant clamp and fan path as heartThread
+//
+static void run_cook(const Config* config, const Options* opt, unsigned int seed, Cook* cook)
+{
+    const ZoneConfig* zone = &config->zones[0];
+    SmokerConfig sim = config->sim;
+    sim.speed = 0.0;
+    sim.seed = seed;
+    sim.pulsesPerRev = config->tachPulse;
+
+    // Vary the day and the fuel load around the configured smoker
+    sim.ambient += 20.0 * (draw(seed, 0) - 0.5);
+    sim.fuelKg *= 0.75 + 0.5 * draw(seed, 1);
+    HalSetup(&sim);
+
+    PwmClock pwm;
+    if (!PwmClockFor(PWM_BASE_LEGACY, config->pwmFreq, &pwm)) pwm.range = 1000;
+    HalPwmSetup(zone->pwmPin, pwm.clock, pwm.range);
+
+    MAX6675 probe = MAX6675Setup(0);
+    FilterChain filter;
+    FilterChainSetup(&filter, config->probeFilter, config->probeFilterStages);
+    Controller controller = ControllerSetup(zone->controllerType, &zone->controllerGains);
+    Fan fan = FanSetup(zone->pwmPin, pwm.range, &config->fan);
+    Lid lid;
+    LidSetup(&lid, &config->lid);
+    bool lidOpen = false;
+
+    Ticker ticker;
+    TickerStart(&ticker, config->refreshMs);
+    double dt = ticker.periodNs / 1e9;
+    long cycles = lround(opt->hours * 3600.0 / dt);
+
+    double temp = sim.ambient;
+    double speed = 0.0;
+    double inBandSince = -1.0;
+    double settledSum = 0.0, settledIn = 0.0, settledErr = 0.0;
+
+    memset(cook, 0, sizeof(*cook));
+    cook->overshoot = -INFINITY;
+    cook->settleS = -1.0;
+
+    for (long n = 0; n < cycles; n++) {
+        TickerWait(&ticker);
+        double now = HalNow() / 1e9;
+
+        MAX6675Reading reading;
+        if (MAX6675Read(probe, &reading) == MAX6675_OK) {
+            temp = FilterChainPush(&filter, reading.value);
+        }
+
+        if (LidUpdate(&lid, now, temp, speed)) {
+            lidOpen = true;
+            speed = FanSet(fan, lid.hold);
+        }
+        else {
+            if (lidOpen) {
+                ControllerReset(controller, temp, speed);
+                lidOpen = false;
+            }
+            double out = ControllerStep(controller, opt->target, temp, dt);
+            double clamped = PlantClamp(&config->plant, zone->controllerGains.ambient, opt->target, temp, out);
+            if (clamped < out) {
+                ControllerTrack(controller, clamped);
+            }
+            speed = FanSet(fan, clamped);
+        }
+
+        Smoker s;
+        HalSimRead(&s);
+        double error = s.pit - opt->target;
+        double t = (n + 1) * dt;
+
+        cook->overshoot = fmax(cook->overshoot, error);
+
+        if (cook->settleS < 0.0) {
+            if (fabs(error) > opt->band) inBandSince = -1.0;
+            else if (inBandSince < 0.0) inBandSince = t;
+            else if (t - inBandSince >= SETTLE_HOLD_S) cook->settleS = inBandSince;
+        }
+        else {
+            settledSum += dt;
+            settledErr += fabs(error) * dt;
+            if (fabs(error) <= opt->band) settledIn += dt;
+        }
+        cook->lidEvents = s.lidEvents;
+    }
+
+    cook->writesPerHour = fan->writes / opt->hours;
+    cook->inBand = settledSum > 0.0 ? settledIn / settledSum : 0.0;
+    cook->mae = settledSum > 0.0 ? settledErr / settledSum : NAN;
+
+    FanFree(fan);
+    ControllerFree(controller);
+    MAX6675Free(probe);
+}
+
+static int compare(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void run_variant(const char* name, const Config* config, const Options* opt)
+{
+    double* overshoots = calloc(opt->cooks, sizeof(double));
+    double overshoot = 0.0, settle = 0.0, writes = 0.0, inBand = 0.0, mae = 0.0;
+    unsigned long lids = 0;
+    int settled = 0;
+
+    if (overshoots == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (int i = 0; i < opt->cooks; i++) {
+        Cook cook;
+        run_cook(config, opt, opt->seed + i, &cook);
+
+        overshoots[i] = cook.overshoot;
+        overshoot += cook.overshoot;
+        writes += cook.writesPerHour;
+        lids += cook.lidEvents;
+        if (cook.settleS >= 0.0) {
+            settled++;
+            settle += cook.settleS;
+            inBand += cook.inBand;
+            mae += cook.mae;
+        }
+    }
+
+    qsort(overshoots, opt->cooks, sizeof(double), compare);
+    double p95 = overshoots[(int)(0.95 * (opt->cooks - 1))];
+    free(overshoots);
+
+    printf("%-24s %-7s %6d %9.1f %6.1f %9.1f %9d %9.1f %8.1f %6.2f %6.1f\n",
+        name, ControllerName(config->zones[0].controllerType), opt->cooks,
+        overshoot / opt->cooks, p95,
+        settled ? settle / settled / 60.0 : NAN, opt->cooks - settled,
+        writes / opt->cooks,
+        settled ? 100.0 * inBand / settled : NAN,
+        settled ? mae / settled : NAN,
+        (double)lids / opt->cooks);
+}
+
+int main(int argc, char** argv)
+{
+    Options opt = { 100, 8.0, 110.0, 5.0, 1 };
+    int first = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "-n"))      opt.cooks = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-H")) opt.hours = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-t")) opt.target = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-b")) opt.band = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-s")) opt.seed = strtoul(argv[++i], NULL, 10);
+        else if (argv[i][0] == '-') { usage(argv[0]); return 2; }
+        else { first = i; break; }
+    }
+    if (opt.cooks < 1 || opt.hours <= 0.0 || opt.band <= 0.0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    LogSetup(LOG_LEVEL_WARN, 0);
+
+    printf("%-24s %-7s %6s %9s %6s %9s %9s %9s %8s %6s %6s\n",
+        "variant", "control", "cooks", "overshoot", "p95", "settle_m", "unsettled", "writes/h", "in_band%", "mae", "lids");
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (first == argc) {
+        run_variant("defaults", ConfigGet(), &opt);
+    }
+    for (int i = first; i < argc; i++) {
+        if (access(argv[i], R_OK) != 0 || ConfigSetup(argv[i]) != 0) {
+            fprintf(stderr, "%s: can't load %s\n", argv[0], argv[i]);
+            return 1;
+        }
+        run_variant(argv[i], ConfigGet(), &opt);
+    }
+
+    fflush(stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int variants = (first == argc) ? 1 : argc - first;
+    fprintf(stderr, "%.0f simulated hours in %.1f s\n", variants * opt.cooks * opt.hours, wall);
+
+    LogClose();
+    return 0;
+}
@@ -0,0 +1,410 @@
+/* Microbenchmarks of the control and HTTP hot paths, and a load generator for a running daemon */
+
+#define _GNU_SOURCE     // strcasestr
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MAX6675.h"
+#include "config.h"
+#include "controller.h"
+#include "filter.h"
+#include "hal.h"
+#include "log.h"
+#include "state.h"
+#include "status.h"
+
+#define BENCH_MIN_NS   200000000ULL    // each benchmark runs at least this long
+#define LOAD_RESPONSE  8192            // largest response the load generator reads
+
+static volatile double sink;           // keeps results alive past the optimiser
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [filter]\n"
+        "       %s -l host:port[/path] [-c clients] [-d seconds]\n"
+        "  runs the microbenchmarks whose name contains filter, or loads a running bbq\n", name, name);
+}
+
+// Runs fn with growing iteration counts until one run takes BENCH_MIN_NS,
+// then reports the time per iteration of that run
+//
+static void measure(const char* name, const char* filter, void (*fn)(void* arg, long n), void* arg)
+{
+    if (filter && !strstr(name, filter)) {
+        return;
+    }
+
+    long n = 1;
+    uint64_t elapsed;
+    for (;;) {
+        uint64_t start = now_ns();
+        fn(arg, n);
+        elapsed = now_ns() - start;
+        if (elapsed >= BENCH_MIN_NS || n > (1L << 40)) break;
+        n = (elapsed > 1000) ? (long)(n * 1.2 * BENCH_MIN_NS / elapsed) + 1 : n * 100;
+    }
+    printf("%-32s %12ld %12.1f ns/op\n", name, n, (double)elapsed / n);
+}
+
+// MAX6675, cached is the decode of a conversion still in the handle, bus
+// forces the SPI transfer through the simulated HAL every time
+//
+static void bench_max6675_cached(void* arg, long n)
+{
+    MAX6675 probe = arg;
+    double sum = 0.0;
+
+    for (long i = 0; i < n; i++) {
+        sum += MAX6675GetTempC(probe);
+    }
+    sink = sum;
+}
+
+static void bench_max6675_bus(void* arg, long n)
+{
+    MAX6675 probe = arg;
+    double sum = 0.0;
+
+    for (long i = 0; i < n; i++) {
+        probe->cached = false;
+        sum += MAX6675GetTempC(probe);
+    }
+    sink = sum;
+}
+
+static void bench_filter(void* arg, long n)
+{
+    FilterChain* chain = arg;
+    double sum = 0.0;
+
+    for (long i = 0; i < n; i++) {
+        sum += FilterChainPush(chain, 110.0f + (i & 7) * 0.25f);
+    }
+    sink = sum;
+}
+
+static void bench_controller(void* arg, long n)
+{
+    Controller controller = arg;
+    double sum = 0.0;
+
+    for (long i = 0; i < n; i++) {
+        sum += ControllerStep(controller, 110.0, 108.0 + (i & 15) * 0.25, 1.0);
+    }
+    sink = sum;
+}
+
+static void bench_status_render(void* arg, long n)
+{
+    BBQState* state = arg;
+    char body[1024];
+    long sum = 0;
+
+    for (long i = 0; i < n; i++) {
+        state->rpm = i & 1023;
+        sum += StatusRender(body, sizeof(body), state);
+    }
+    sink = sum;
+}
+
+// StatusUpdate renders, compares against the cached body and, when it
+// changed, swaps in a new response as heartThread does once per cycle
+static void bench_status_update(void* arg, long n)
+{
+    BBQState* state = arg;
+
+    for (long i = 0; i < n; i++) {
+        state->rpm = i & 1023;
+        StatusUpdate(state);
+    }
+}
+
+static int run_micro(const char* filter)
+{
+    const Config* config = ConfigGet();
+
+    SmokerConfig sim = config->sim;
+    sim.speed = 0.0;
+    sim.pulsesPerRev = config->tachPulse;
+    HalSetup(&sim);
+
+    MAX6675 probe = MAX6675Setup(0);
+    if (probe == NULL) {
+        fprintf(stderr, "probe setup failed\n");
+        return 1;
+    }
+
+    FilterChain chain;
+    FilterChainSetup(&chain, config->probeFilter, config->probeFilterStages);
+
+    Controller pid = ControllerSetup(CONTROLLER_PID, &config->zones[0].controllerGains);
+    Controller legacy = ControllerSetup(CONTROLLER_LEGACY, &config->zones[0].controllerGains);
+    if (pid == NULL || legacy == NULL) {
+        fprintf(stderr, "controller setup failed\n");
+        return 1;
+    }
+
+    BBQState state = {
+        .targetState = 1, .targetTemp = 110.0, .currentState = 1, .currentTemp = 109.25,
+        .probeCount = 2, .probeTemps = { 109.25f, 71.5f }, .etaSeconds = { -1.0f, 5400.0f },
+        .speed = 37.5, .rpm = 900, .controller = CONTROLLER_PID,
+        .pidP = 1.2, .pidI = 30.4, .pidD = -0.3, .pidFF = 5.0,
+    };
+    StatusSetup(true);
+
+    printf("%-32s %12s %12s\n", "benchmark", "iterations", "time");
+    measure("max6675_get_temp_cached", filter, bench_max6675_cached, probe);
+    measure("max6675_get_temp_bus", filter, bench_max6675_bus, probe);
+    measure("filter_chain_push", filter, bench_filter, &chain);
+    measure("controller_step_pid", filter, bench_controller, pid);
+    measure("controller_step_legacy", filter, bench_controller, legacy);
+    measure("status_render", filter, bench_status_render, &state);
+    measure("status_update", filter, bench_status_update, &state);
+
+    ControllerFree(pid);
+    ControllerFree(legacy);
+    MAX6675Free(probe);
+    return 0;
+}
+
+// Load generator, every client keeps one connection and requests the
+// same path back to back for the duration
+//
+typedef struct LoadClient {
+    pthread_t   tid;
+    const struct addrinfo* addr;
+    const char* host;
+    const char* path;
+    uint64_t    until;
+    uint64_t*   latencies;
+    long        count;
+    long        capacity;
+    long        errors;
+    long        reconnects;
+} LoadClient;
+
+static int load_connect(const struct addrinfo* addr)
+{
+    int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+
+    int one = 1;
+
+    if (fd >= 0) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// Reads one response, returns false if the connection has to be reopened
+static bool load_response(int fd, char* buf, bool* keepAlive)
+{
+    size_t len = 0;
+    char* body = NULL;
+
+    while (body == NULL) {
+        ssize_t n = read(fd, buf + len, LOAD_RESPONSE - 1 - len);
+        if (n <= 0) return false;
+        len += n;
+        buf[len] = '\0';
+        body = strstr(buf, "\r\n\r\n");
+        if (body == NULL && len == LOAD_RESPONSE - 1) return false;
+    }
+    body += 4;
+
+    const char* field = strcasestr(buf, "\r\nContent-Length:");
+    size_t want = field ? strtoul(field + 17, NULL, 10) : 0;
+    size_t have = len - (body - buf);
+
+    while (have < want) {
+        char drain[1024];
+        ssize_t n = read(fd, drain, sizeof(drain));
+        if (n <= 0) return false;
+        have += n;
+    }
+
+    // HTTP/1.0 closes unless asked not to, 1.1 keeps the connection unless told otherwise
+    *keepAlive = strncmp(buf, "HTTP/1.0", 8)
+        ? strcasestr(buf, "\r\nConnection: close") == NULL
+        : strcasestr(buf, "\r\nConnection: keep-alive") != NULL;
+    return strncmp(buf, "HTTP/1.1 2", 10) == 0 || strncmp(buf, "HTTP/1.0 2", 10) == 0;
+}
+
+static void* load_thread(void* arg)
+{
+    LoadClient* client = arg;
+    char request[512];
+    char* buf = malloc(LOAD_RESPONSE);
+    int fd = -1;
+
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", client->path, client->host);
+
+    while (buf && now_ns() < client->until) {
+        if (fd < 0) {
+            if ((fd = load_connect(client->addr)) < 0) {
+                client->errors++;
+                usleep(10000);
+                continue;
+            }
+            client->reconnects++;
+        }
+
+        uint64_t start = now_ns();
+        bool keepAlive = false;
+        bool ok = write(fd, request, len) == len && load_response(fd, buf, &keepAlive);
+        uint64_t latency = now_ns() - start;
+
+        if (!ok) {
+            client->errors++;
+        }
+        else {
+            if (client->count == client->capacity) {
+                long capacity = client->capacity ? client->capacity * 2 : 4096;
+                uint64_t* grown = realloc(client->latencies, capacity * sizeof(uint64_t));
+                if (grown == NULL) break;
+                client->latencies = grown;
+                client->capacity = capacity;
+            }
+            client->latencies[client->count++] = latency;
+        }
+
+        if (!ok || !keepAlive) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd >= 0) close(fd);
+    free(buf);
+    return arg;
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int run_load(const char* target, int clients, int seconds)
+{
+    char host[256];
+    const char* path = strchr(target, '/');
+    size_t hostLen = path ? (size_t)(path - target) : strlen(target);
+
+    if (hostLen >= sizeof(host)) {
+        fprintf(stderr, "host too long\n");
+        return 2;
+    }
+    memcpy(host, target, hostLen);
+    host[hostLen] = '\0';
+    if (path == NULL) path = "/status";
+
+    char* port = strrchr(host, ':');
+    if (port) *port++ = '\0';
+
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* addr;
+    int rc = getaddrinfo(host, port ? port : "80", &hints, &addr);
+    if (rc != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(rc));
+        return 1;
+    }
+
+    LoadClient* pool = calloc(clients, sizeof(LoadClient));
+    if (pool == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < clients; i++) {
+        pool[i] = (LoadClient) { .addr = addr, .host = host, .path = path, .until = start + seconds * 1000000000ULL };
+        if (pthread_create(&pool[i].tid, NULL, load_thread, &pool[i]) != 0) {
+            fprintf(stderr, "can't start client %d\n", i);
+            clients = i;
+            break;
+        }
+    }
+
+    long total = 0, errors = 0, reconnects = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(pool[i].tid, NULL);
+        total += pool[i].count;
+        errors += pool[i].errors;
+        reconnects += pool[i].reconnects;
+    }
+    double wall = (now_ns() - start) / 1e9;
+
+    uint64_t* all = malloc((total ? total : 1) * sizeof(uint64_t));
+    long n = 0;
+    for (int i = 0; all && i < clients; i++) {
+        memcpy(all + n, pool[i].latencies, pool[i].count * sizeof(uint64_t));
+        n += pool[i].count;
+        free(pool[i].latencies);
+    }
+    free(pool);
+    freeaddrinfo(addr);
+
+    if (all == NULL || n == 0) {
+        fprintf(stderr, "no successful requests, %ld errors\n", errors);
+        free(all);
+        return 1;
+    }
+    qsort(all, n, sizeof(uint64_t), compare_u64);
+
+    printf("%s%s, %d clients, %.1f s\n", target, strchr(target, '/') ? "" : "/status", clients, wall);
+    printf("requests %ld (%.0f/s), errors %ld, connections %ld\n", n, n / wall, errors, reconnects);
+    printf("latency us p50 %.0f p90 %.0f p99 %.0f p99.9 %.0f max %.0f\n",
+        all[n / 2] / 1e3, all[(long)(n * 0.9)] / 1e3, all[(long)(n * 0.99)] / 1e3,
+        all[(long)(n * 0.999)] / 1e3, all[n - 1] / 1e3);
+
+    free(all);
+    return errors ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* load = NULL;
+    const char* filter = NULL;
+    int clients = 8;
+    int seconds = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "-l"))      load = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "-c")) clients = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-d")) seconds = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && filter == NULL)     filter = argv[i];
+        else { usage(argv[0]); return 2; }
+    }
+    if (clients < 1 || seconds < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    LogSetup(LOG_LEVEL_WARN, 0);
+    int ret = load ? run_load(load, clients, seconds) : run_micro(filter);
+    LogClose();
+    return ret;
+}
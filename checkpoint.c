@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "hal.h"
+#include "log.h"
+#include "seqlock.h"
+
+
+SEQLOCK_DEFINE(latest, Checkpoint);
+
+static char path[256];
+static char tmpPath[sizeof(path) + 8];
+static char dirPath[sizeof(path)];
+static int interval;
+static bool running;
+static atomic_bool stopping;
+static pthread_t writerTid;
+static sem_t wake;		// posted by an urgent save and by close
+
+int CheckpointLoad(const char* file, Checkpoint* checkpoint) {
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+
+	ssize_t n = read(fd, checkpoint, sizeof(*checkpoint));
+	close(fd);
+
+	if (n != sizeof(*checkpoint)
+		|| memcmp(checkpoint->magic, CHECKPOINT_MAGIC, sizeof(checkpoint->magic))
+		|| checkpoint->version != CHECKPOINT_VERSION
+		|| checkpoint->size != sizeof(*checkpoint)
+		|| checkpoint->zones < 1 || checkpoint->zones > STATE_MAX_ZONES
+		|| checkpoint->probes < 0 || checkpoint->probes > STATE_MAX_PROBES) {
+		Log(LOG_LEVEL_WARN, "checkpoint : %s is not a compatible checkpoint", file);
+		return -1;
+	}
+	return 0;
+}
+
+static bool write_file(const Checkpoint* checkpoint) {
+	int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+
+	const char* p = (const char*)checkpoint;
+	size_t len = sizeof(*checkpoint);
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		p += n;
+		len -= n;
+	}
+
+	bool ok = len == 0 && fdatasync(fd) == 0;
+	ok = (close(fd) == 0) && ok;
+	if (!ok || rename(tmpPath, path) != 0) {
+		unlink(tmpPath);
+		return false;
+	}
+
+	// The rename is only durable once the directory entry is on disk
+	int dir = open(dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir < 0) {
+		return false;
+	}
+	ok = fsync(dir) == 0;
+	close(dir);
+	return ok;
+}
+
+// Writes the latest state if a new one was handed over since the last write
+static void write_latest(unsigned int* written) {
+	Checkpoint checkpoint;
+
+	unsigned int version = SeqLockRead(&latest, &checkpoint);
+	if (version == 0 || version == *written) {
+		return;
+	}
+
+	memcpy(checkpoint.magic, CHECKPOINT_MAGIC, sizeof(checkpoint.magic));
+	checkpoint.version = CHECKPOINT_VERSION;
+	checkpoint.size = sizeof(checkpoint);
+	checkpoint.savedAt = HalTime();
+
+	if (write_file(&checkpoint)) {
+		*written = version;
+	}
+	else {
+		Log(LOG_LEVEL_WARN, "checkpoint : can't write %s: %s", path, strerror(errno));
+	}
+}
+
+static void* writer_thread(void* arg) {
+	unsigned int written = 0;
+
+	while (!stopping) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += interval;
+
+		while (sem_timedwait(&wake, &deadline) != 0 && errno == EINTR) {
+		}
+		// Several urgent saves in a row make one write
+		while (sem_trywait(&wake) == 0) {
+		}
+		write_latest(&written);
+	}
+
+	return arg;
+}
+
+int CheckpointSetup(const char* file, int intervalSeconds) {
+	snprintf(path, sizeof(path), "%s", file);
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+	const char* slash = strrchr(path, '/');
+	if (slash == NULL) {
+		snprintf(dirPath, sizeof(dirPath), ".");
+	} else {
+		snprintf(dirPath, sizeof(dirPath), "%.*s", (slash == path) ? 1 : (int)(slash - path), path);
+	}
+	interval = (intervalSeconds > 0) ? intervalSeconds : 1;
+	stopping = false;
+
+	if (sem_init(&wake, 0, 0) != 0) {
+		return -1;
+	}
+	if (pthread_create(&writerTid, NULL, writer_thread, NULL) != 0) {
+		sem_destroy(&wake);
+		return -1;
+	}
+	running = true;
+	return 0;
+}
+
+void CheckpointSave(const Checkpoint* checkpoint, bool urgent) {
+	SeqLockWrite(&latest, checkpoint);
+	if (urgent && running) {
+		sem_post(&wake);
+	}
+}
+
+void CheckpointClose(void) {
+	if (!running) {
+		return;
+	}
+
+	// The thread's last pass writes whatever is still pending
+	stopping = true;
+	sem_post(&wake);
+	pthread_join(writerTid, NULL);
+	sem_destroy(&wake);
+	running = false;
+}
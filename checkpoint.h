@@ -0,0 +1,57 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "filter.h"
+#include "state.h"
+
+// Controller state checkpoint.
+//
+// heartThread hands its state over every cycle without blocking.  A
+// background thread writes the latest copy out once per interval, or
+// straight away when a set point changed, to a temporary file that is
+// fsync'd and renamed over the checkpoint, then the directory is synced,
+// so a power cut leaves the old or the new one.  It is read back at start up, before the first control
+// cycle, so a reboot mid-cook carries on where it left off.
+
+#define CHECKPOINT_MAGIC   "BBQSTATE"
+#define CHECKPOINT_VERSION 1
+
+typedef struct CheckpointZone {
+	int32_t		targetState;
+	int32_t		controller;	// ControllerType the integrator belongs to
+	double		targetTemp;
+	double		currentTemp;
+	double		integral;
+	double		output;
+	double		speed;		// fan duty
+} CheckpointZone;
+
+typedef struct Checkpoint {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	size;		// sizeof(Checkpoint) of the writer
+	int64_t		savedAt;	// HalTime() of the write, filled in by the writer
+	int32_t		zones;
+	int32_t		probes;
+	CheckpointZone	zone[STATE_MAX_ZONES];
+	FilterChain	filters[STATE_MAX_PROBES];
+} Checkpoint;
+
+
+// Reads the checkpoint at path, -1 if there is none or it is not compatible
+int CheckpointLoad(const char* path, Checkpoint* checkpoint);
+
+// Starts the writer thread.  Returns -1 if it can't be started.
+int CheckpointSetup(const char* path, int intervalSeconds);
+
+// Hands over the latest state, never blocks.  urgent has it written now
+// rather than at the end of the interval.
+void CheckpointSave(const Checkpoint* checkpoint, bool urgent);
+
+// Final write, stops the thread
+void CheckpointClose(void);
+
+#endif
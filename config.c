@@ -0,0 +1,699 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "log.h"
+
+
+typedef enum {
+	CONFIG_INT,
+	CONFIG_DOUBLE,
+	CONFIG_STRING,
+	CONFIG_CHOICE,		// one of a list of names, stored as its index
+	CONFIG_CHANNELS,	// comma separated list of probe channels
+	CONFIG_FILTERS,		// comma separated type[:taps|alpha] stages
+} ConfigType;
+
+typedef struct ConfigKey {
+	const char*	section;
+	const char*	key;
+	ConfigType	type;
+	size_t		offset;
+	double		min;
+	double		max;
+	const char* const* choices;
+	bool		live;		// picked up without a restart
+} ConfigKey;
+
+static const char* const controllerChoices[] = { "legacy", "pid", NULL };
+static const char* const serverChoices[] = { "thread", "epoll", NULL };
+static const char* const tachChoices[] = { "gpiod", "wiringpi", NULL };
+static const char* const logChoices[] = { "error", "warn", "info", "debug", NULL };
+static const char* const ruleChoices[] = { "tyreus-luyben", "ziegler-nichols", NULL };
+
+#define INT_KEY(s, k, f, lo, hi, l)	{ s, k, CONFIG_INT, offsetof(Config, f), lo, hi, NULL, l }
+#define DOUBLE_KEY(s, k, f, lo, hi, l)	{ s, k, CONFIG_DOUBLE, offsetof(Config, f), lo, hi, NULL, l }
+#define STRING_KEY(s, k, f, l)		{ s, k, CONFIG_STRING, offsetof(Config, f), 0, sizeof(((Config*)0)->f), NULL, l }
+#define CHOICE_KEY(s, k, f, c, l)	{ s, k, CONFIG_CHOICE, offsetof(Config, f), 0, 0, c, l }
+
+#define LIVE	true
+#define RESTART	false
+
+// Controller of zone n, [control] for zone 0
+#define CONTROL_KEYS(s, n) \
+	CHOICE_KEY(s, "controller", zones[n].controllerType, controllerChoices, LIVE), \
+	DOUBLE_KEY(s, "kp", zones[n].controllerGains.kp, 0, 1000, LIVE), \
+	DOUBLE_KEY(s, "ki", zones[n].controllerGains.ki, 0, 1000, LIVE), \
+	DOUBLE_KEY(s, "kd", zones[n].controllerGains.kd, 0, 1000, LIVE), \
+	DOUBLE_KEY(s, "kff", zones[n].controllerGains.kff, 0, 1000, LIVE), \
+	DOUBLE_KEY(s, "ambient", zones[n].controllerGains.ambient, -50, 100, LIVE)
+
+// Every setting of zone n > 0 under one section
+#define ZONE_KEYS(s, n) \
+	INT_KEY(s, "probe", zones[n].controlProbe, 0, STATE_MAX_PROBES - 1, RESTART), \
+	INT_KEY(s, "pin", zones[n].pwmPin, 0, 40, RESTART), \
+	CONTROL_KEYS(s, n)
+
+static const ConfigKey keys[] = {
+	CHOICE_KEY("general", "log_level", logLevel, logChoices, LIVE),
+	INT_KEY("general", "log_rate", logRate, 0, 100000, LIVE),
+	INT_KEY("general", "refresh_ms", refreshMs, 100, 60000, LIVE),
+
+	{ "probe", "channels", CONFIG_CHANNELS, offsetof(Config, probeChannels), 0, 1, NULL, RESTART },
+	INT_KEY("probe", "control", zones[0].controlProbe, 0, STATE_MAX_PROBES - 1, RESTART),
+	INT_KEY("probe", "fault_reads", probeFaultReads, 1, 1000, LIVE),
+
+	{ "filter", "stages", CONFIG_FILTERS, offsetof(Config, probeFilter), 0, 0, NULL, LIVE },
+
+	INT_KEY("pwm", "pin", zones[0].pwmPin, 0, 40, RESTART),
+	INT_KEY("pwm", "base_freq", piFreq, 0, 1000000000, RESTART),
+	INT_KEY("pwm", "freq", pwmFreq, 1, 1000000, RESTART),
+
+	DOUBLE_KEY("fan", "min_duty", fan.minDuty, 0, 100, LIVE),
+	DOUBLE_KEY("fan", "kick_duty", fan.kickDuty, 0, 100, LIVE),
+	INT_KEY("fan", "kick_ms", fan.kickMs, 0, 10000, LIVE),
+	DOUBLE_KEY("fan", "deadband", fan.deadband, 0, 50, LIVE),
+	DOUBLE_KEY("fan", "hysteresis", fan.hysteresis, 0, 50, LIVE),
+	DOUBLE_KEY("fan", "slew_rate", fan.slewRate, 0, 1000, LIVE),
+
+	INT_KEY("tach", "pin", tachPin, 0, 40, RESTART),
+	INT_KEY("tach", "pulses", tachPulse, 1, 16, LIVE),
+	CHOICE_KEY("tach", "backend", tachBackend, tachChoices, RESTART),
+	STRING_KEY("tach", "gpio_chip", tachGpioChip, RESTART),
+	INT_KEY("tach", "gpio_line", tachGpioLine, 0, 512, RESTART),
+	INT_KEY("tach", "debounce_us", tachDebounceUs, 0, 1000000, LIVE),
+	INT_KEY("tach", "window_ms", tachWindowMs, 100, 60000, LIVE),
+	INT_KEY("tach", "stall_ms", tachStallMs, 100, 600000, LIVE),
+	INT_KEY("tach", "stall_duty", tachStallDuty, 0, 100, LIVE),
+
+	CONTROL_KEYS("control", 0),
+
+	INT_KEY("zones", "count", zoneCount, 1, STATE_MAX_ZONES, RESTART),
+	ZONE_KEYS("zone1", 1),
+
+	DOUBLE_KEY("lid", "drop_rate", lid.dropRate, 0, 100, LIVE),
+	DOUBLE_KEY("lid", "min_drop", lid.minDrop, 0, 500, LIVE),
+	INT_KEY("lid", "window_s", lid.windowS, 1, 600, LIVE),
+	DOUBLE_KEY("lid", "recovery", lid.recovery, 0, 500, LIVE),
+	INT_KEY("lid", "timeout_s", lid.timeoutS, 0, 7200, LIVE),
+
+	DOUBLE_KEY("plant", "gain", plant.gain, 0, 100, LIVE),
+	DOUBLE_KEY("plant", "tau", plant.tau, 1, 86400, LIVE),
+	DOUBLE_KEY("plant", "horizon", plant.horizon, 0, 86400, LIVE),
+	DOUBLE_KEY("plant", "margin", plant.margin, 0, 100, LIVE),
+
+	DOUBLE_KEY("eta", "done_temp", eta.doneTemp, 0, 300, LIVE),
+	INT_KEY("eta", "interval_s", eta.intervalS, 10, 3600, LIVE),
+	DOUBLE_KEY("eta", "forgetting", eta.forgetting, 0.5, 1, LIVE),
+	DOUBLE_KEY("eta", "stall_low", eta.stallLow, 0, 300, LIVE),
+	DOUBLE_KEY("eta", "stall_high", eta.stallHigh, 0, 300, LIVE),
+	DOUBLE_KEY("eta", "stall_rate", eta.stallRate, 0, 100, LIVE),
+
+	DOUBLE_KEY("autotune", "step", autotune.step, 1, 50, LIVE),
+	DOUBLE_KEY("autotune", "hysteresis", autotune.hysteresis, 0, 50, LIVE),
+	INT_KEY("autotune", "cycles", autotune.cycles, 1, 20, LIVE),
+	INT_KEY("autotune", "timeout_s", autotune.timeoutS, 60, 86400, LIVE),
+	CHOICE_KEY("autotune", "rule", autotune.rule, ruleChoices, LIVE),
+
+	INT_KEY("http", "port", bindPort, 1, 65535, RESTART),
+	CHOICE_KEY("http", "mode", serverMode, serverChoices, RESTART),
+	INT_KEY("http", "threads", threadPoolSize, 1, 64, RESTART),
+	INT_KEY("http", "keep_alive", keepAlive, 0, 1, RESTART),
+	INT_KEY("http", "timeout", connectionTimeout, 0, 3600, RESTART),
+	INT_KEY("http", "events_max_clients", eventsMaxClients, 0, 256, RESTART),
+
+	STRING_KEY("mqtt", "host", mqtt.host, RESTART),
+	INT_KEY("mqtt", "port", mqtt.port, 1, 65535, RESTART),
+	STRING_KEY("mqtt", "client_id", mqtt.clientId, RESTART),
+	STRING_KEY("mqtt", "username", mqtt.username, RESTART),
+	STRING_KEY("mqtt", "password", mqtt.password, RESTART),
+	STRING_KEY("mqtt", "prefix", mqtt.prefix, RESTART),
+	INT_KEY("mqtt", "keep_alive", mqtt.keepAlive, 5, 3600, RESTART),
+	INT_KEY("mqtt", "qos", mqtt.qos, 0, 2, RESTART),
+
+	INT_KEY("rt", "lock_memory", rtLockMemory, 0, 1, RESTART),
+	INT_KEY("rt", "acquire_priority", rtAcquirePriority, 0, 99, RESTART),
+	INT_KEY("rt", "acquire_cpu", rtAcquireCpu, -1, 63, RESTART),
+	INT_KEY("rt", "control_priority", rtControlPriority, 0, 99, RESTART),
+	INT_KEY("rt", "control_cpu", rtControlCpu, -1, 63, RESTART),
+
+	STRING_KEY("log", "cook_log", cookLogPath, RESTART),
+	INT_KEY("log", "flush_s", cookLogFlushS, 1, 3600, RESTART),
+
+	STRING_KEY("checkpoint", "path", checkpointPath, RESTART),
+	INT_KEY("checkpoint", "interval_s", checkpointIntervalS, 1, 3600, RESTART),
+	INT_KEY("checkpoint", "max_age_s", checkpointMaxAgeS, 0, 86400, RESTART),
+
+	DOUBLE_KEY("sim", "speed", sim.speed, 0, 10000, RESTART),
+	DOUBLE_KEY("sim", "ambient", sim.ambient, -30, 50, RESTART),
+	DOUBLE_KEY("sim", "meat_start", sim.meatStart, -30, 50, RESTART),
+	DOUBLE_KEY("sim", "fuel_kg", sim.fuelKg, 0.1, 50, RESTART),
+	DOUBLE_KEY("sim", "burn_rate", sim.burnRate, 0.01, 20, RESTART),
+	DOUBLE_KEY("sim", "heat_gain", sim.heatGain, 0.01, 10, RESTART),
+	DOUBLE_KEY("sim", "idle_air", sim.idleAir, 0, 1, RESTART),
+	DOUBLE_KEY("sim", "loss", sim.loss, 0.00001, 1, RESTART),
+	DOUBLE_KEY("sim", "fan_lag_s", sim.fanLagS, 0, 60, RESTART),
+	DOUBLE_KEY("sim", "fan_min_duty", sim.fanMinDuty, 0, 100, RESTART),
+	DOUBLE_KEY("sim", "fan_max_rpm", sim.fanMaxRpm, 0, 20000, RESTART),
+	DOUBLE_KEY("sim", "lid_every_s", sim.lidEveryS, 0, 86400, RESTART),
+	DOUBLE_KEY("sim", "lid_open_s", sim.lidOpenS, 0, 3600, RESTART),
+	DOUBLE_KEY("sim", "lid_loss", sim.lidLoss, 0, 1, RESTART),
+	DOUBLE_KEY("sim", "meat_tau_s", sim.meatTauS, 60, 100000, RESTART),
+	DOUBLE_KEY("sim", "noise", sim.noise, 0, 10, RESTART),
+	INT_KEY("sim", "seed", sim.seed, 0, INT_MAX, RESTART),
+};
+
+#define DEFAULT_GAINS { .kp = 4.0, .ki = 0.01, .kd = 10.0, .kff = 0.0, .ambient = 20.0 }
+
+static const Config defaults = {
+	.logLevel		= LOG_LEVEL_DEBUG,
+	.logRate		= 50,
+	.refreshMs		= 1000,
+
+	.probeChannels		= { 0 },
+	.probeCount		= 1,
+	.probeFaultReads	= 3,
+
+	.probeFilter		= {
+		{ FILTER_MEDIAN, 5, 0.0 },	// median of 5 rejects single sample spikes
+		{ FILTER_EMA,    0, 0.3 },	// EMA with alpha 0.3 smooths the 0.25 degree steps
+	},
+	.probeFilterStages	= 2,
+
+	.piFreq			= 0,		// detect from the board model
+	.pwmFreq		= 25000,
+
+	.fan			= {
+		.minDuty	= 0.0,
+		.kickDuty	= 0.0,
+		.kickMs		= 1000,
+		.deadband	= 0.5,
+		.hysteresis	= 1.0,
+		.slewRate	= 5.0,
+	},
+
+	.tachPin		= 3,		// GPIO22 as per BCM
+	.tachPulse		= 2,
+	.tachBackend		= TachBackend_Gpiod,
+	.tachGpioChip		= "/dev/gpiochip0",
+	.tachGpioLine		= 22,
+	.tachDebounceUs		= 1000,
+	.tachWindowMs		= 2000,
+	.tachStallMs		= 3000,
+	.tachStallDuty		= 15,
+
+	.zoneCount		= 1,
+	.zones			= {
+		{ 0, 1,  CONTROLLER_PID, DEFAULT_GAINS },	// GPIO18, hardware PWM0
+		{ 1, 24, CONTROLLER_PID, DEFAULT_GAINS },	// GPIO19, hardware PWM1
+	},
+
+	.lid			= {
+		.dropRate	= 0.5,
+		.minDrop	= 10.0,
+		.windowS	= 30,
+		.recovery	= 5.0,
+		.timeoutS	= 900,
+	},
+
+	.plant			= {
+		.gain		= 0.0,
+		.tau		= 900.0,
+		.horizon	= 300.0,
+		.margin		= 2.0,
+	},
+
+	.eta			= {
+		.doneTemp	= 95.0,
+		.intervalS	= 60,
+		.forgetting	= 0.995,
+		.stallLow	= 65.0,
+		.stallHigh	= 75.0,
+		.stallRate	= 2.0,
+	},
+
+	.autotune		= {
+		.step		= 20.0,
+		.hysteresis	= 2.0,
+		.cycles		= 4,
+		.timeoutS	= 5400,
+		.rule		= AUTOTUNE_TYREUS_LUYBEN,
+	},
+
+	.bindPort		= 80,
+	.serverMode		= ServerMode_Epoll,
+	.threadPoolSize		= 2,
+	.keepAlive		= 1,
+	.connectionTimeout	= 30,
+	.eventsMaxClients	= 8,
+
+	.mqtt			= {
+		.host		= "",
+		.port		= 1883,
+		.clientId	= "bbq",
+		.prefix		= "bbq",
+		.keepAlive	= 30,
+		.qos		= 1,
+	},
+
+	.rtLockMemory		= 1,
+	.rtAcquirePriority	= 50,
+	.rtAcquireCpu		= 3,
+	.rtControlPriority	= 40,
+	.rtControlCpu		= 2,
+
+	.cookLogPath		= "/var/lib/bbq/cook.log",
+	.cookLogFlushS		= 30,
+
+	.checkpointPath		= "/var/lib/bbq/checkpoint",
+	.checkpointIntervalS	= 30,
+	.checkpointMaxAgeS	= 900,
+
+	.sim			= {
+		.speed		= 1.0,
+		.ambient	= 20.0,
+		.meatStart	= 5.0,
+		.fuelKg		= 4.0,
+		.burnRate	= 1.5,
+		.heatGain	= 0.4,
+		.idleAir	= 0.15,
+		.loss		= 0.0011,	// 15 minute pit time constant
+		.fanLagS	= 3.0,
+		.fanMinDuty	= 10.0,
+		.fanMaxRpm	= 2000.0,
+		.lidEveryS	= 3600.0,
+		.lidOpenS	= 60.0,
+		.lidLoss	= 0.005,
+		.meatTauS	= 5400.0,
+		.noise		= 0.3,
+		.seed		= 1,
+	},
+};
+
+static _Atomic(const Config*) current = &defaults;
+static char configPath[256];
+
+static char* trim(char* s) {
+	while (isspace((unsigned char)*s)) s++;
+
+	char* end = s + strlen(s);
+	while (end > s && isspace((unsigned char)end[-1])) end--;
+	*end = '\0';
+
+	return s;
+}
+
+static bool parse_int(const char* text, long* out) {
+	char* end;
+
+	errno = 0;
+	*out = strtol(text, &end, 0);
+	return errno == 0 && end != text && *trim(end) == '\0';
+}
+
+static bool parse_double(const char* text, double* out) {
+	char* end;
+
+	errno = 0;
+	*out = strtod(text, &end);
+	return errno == 0 && end != text && *trim(end) == '\0';
+}
+
+static bool parse_channels(char* text, Config* config) {
+	int count = 0;
+
+	for (char* tok = strtok(text, ","); tok; tok = strtok(NULL, ",")) {
+		long channel;
+		if (count == STATE_MAX_PROBES || !parse_int(trim(tok), &channel) || channel < 0 || channel > 1) {
+			return false;
+		}
+		config->probeChannels[count++] = channel;
+	}
+
+	config->probeCount = count;
+	return count > 0;
+}
+
+static bool parse_filters(char* text, Config* config) {
+	int count = 0;
+
+	if (!strcmp(trim(text), "none")) {
+		config->probeFilterStages = 0;
+		return true;
+	}
+
+	for (char* tok = strtok(text, ","); tok; tok = strtok(NULL, ",")) {
+		FilterConfig* stage = &config->probeFilter[count];
+		char* arg = strchr(tok, ':');
+		if (count == FILTER_MAX_STAGES || arg == NULL) {
+			return false;
+		}
+		*arg++ = '\0';
+		tok = trim(tok);
+
+		long taps = 0;
+		double alpha = 0.0;
+		if (!strcmp(tok, "average") || !strcmp(tok, "median")) {
+			if (!parse_int(trim(arg), &taps) || taps < 1 || taps > FILTER_MAX_TAPS) return false;
+			stage->type = !strcmp(tok, "average") ? FILTER_AVERAGE : FILTER_MEDIAN;
+		} else if (!strcmp(tok, "ema")) {
+			if (!parse_double(trim(arg), &alpha) || alpha <= 0.0 || alpha > 1.0) return false;
+			stage->type = FILTER_EMA;
+		} else {
+			return false;
+		}
+		stage->taps = taps;
+		stage->alpha = alpha;
+		count++;
+	}
+
+	config->probeFilterStages = count;
+	return true;
+}
+
+static bool set_value(const ConfigKey* k, char* value, Config* config) {
+	char* field = (char*)config + k->offset;
+	long i;
+	double d;
+
+	switch(k->type) {
+		case CONFIG_INT:
+			if (!parse_int(value, &i) || i < k->min || i > k->max) return false;
+			*(int*)field = i;
+			return true;
+
+		case CONFIG_DOUBLE:
+			if (!parse_double(value, &d) || d < k->min || d > k->max) return false;
+			*(double*)field = d;
+			return true;
+
+		case CONFIG_STRING:
+			if (strlen(value) >= (size_t)k->max) return false;
+			strcpy(field, value);
+			return true;
+
+		case CONFIG_CHOICE:
+			for (int c = 0; k->choices[c]; c++) {
+				if (!strcmp(value, k->choices[c])) {
+					*(int*)field = c;
+					return true;
+				}
+			}
+			return false;
+
+		case CONFIG_CHANNELS:
+			return parse_channels(value, config);
+
+		case CONFIG_FILTERS:
+			return parse_filters(value, config);
+	}
+	return false;
+}
+
+// Parses path over a copy of the defaults, returns -1 on error and 1 if
+// the file does not exist
+static int parse_file(const char* path, Config* config) {
+	FILE* f = fopen(path, "r");
+	char line[512];
+	char section[32] = "general";
+	int lineNo = 0;
+	int ret = 0;
+
+	*config = defaults;
+	if (f == NULL) {
+		return (errno == ENOENT) ? 1 : -1;
+	}
+
+	while (ret == 0 && fgets(line, sizeof(line), f)) {
+		lineNo++;
+
+		char* hash = strchr(line, '#');
+		if (hash) *hash = '\0';
+		char* text = trim(line);
+		if (*text == '\0') {
+			continue;
+		}
+
+		if (*text == '[') {
+			char* close = strchr(text, ']');
+			if (close == NULL || close - text - 1 >= (int)sizeof(section)) {
+				Log(LOG_LEVEL_ERROR, "config : %s:%d: bad section header", path, lineNo);
+				ret = -1;
+				break;
+			}
+			*close = '\0';
+			strcpy(section, trim(text + 1));
+			continue;
+		}
+
+		char* eq = strchr(text, '=');
+		if (eq == NULL) {
+			Log(LOG_LEVEL_ERROR, "config : %s:%d: expected key = value", path, lineNo);
+			ret = -1;
+			break;
+		}
+		*eq = '\0';
+		char* key = trim(text);
+		char* value = trim(eq + 1);
+
+		const ConfigKey* k = NULL;
+		for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+			if (!strcmp(keys[i].section, section) && !strcmp(keys[i].key, key)) {
+				k = &keys[i];
+				break;
+			}
+		}
+
+		if (k == NULL) {
+			Log(LOG_LEVEL_ERROR, "config : %s:%d: unknown key %s.%s", path, lineNo, section, key);
+			ret = -1;
+		} else if (!set_value(k, value, config)) {
+			Log(LOG_LEVEL_ERROR, "config : %s:%d: bad value for %s.%s: %s", path, lineNo, section, key, value);
+			ret = -1;
+		}
+	}
+	fclose(f);
+
+	// Every zone needs a pit probe and a fan of its own
+	for (int i = 0; ret == 0 && i < config->zoneCount; i++) {
+		const ZoneConfig* zone = &config->zones[i];
+		if (zone->controlProbe >= config->probeCount) {
+			Log(LOG_LEVEL_ERROR, "config : %s: zone %d probe %d but only %d probe(s)", path, i, zone->controlProbe, config->probeCount);
+			ret = -1;
+		}
+		for (int j = 0; ret == 0 && j < i; j++) {
+			if (zone->controlProbe == config->zones[j].controlProbe || zone->pwmPin == config->zones[j].pwmPin) {
+				Log(LOG_LEVEL_ERROR, "config : %s: zones %d and %d share a probe or a pin", path, j, i);
+				ret = -1;
+			}
+		}
+	}
+
+	// The lid slope is fitted over one sample per cycle out of a fixed
+	// ring, a longer window than the ring spans would quietly be cut short
+	int lidMaxS = (LID_RING_SIZE - 1) * config->refreshMs / 1000;
+	if (ret == 0 && config->lid.windowS > lidMaxS) {
+		Log(LOG_LEVEL_WARN, "config : %s: lid.window_s %d is more than %d samples at refresh_ms %d, using %ds",
+			path, config->lid.windowS, LID_RING_SIZE, config->refreshMs, lidMaxS);
+		config->lid.windowS = lidMaxS;
+	}
+	return ret;
+}
+
+static size_t field_size(const ConfigKey* k) {
+	switch(k->type) {
+		case CONFIG_DOUBLE:	return sizeof(double);
+		case CONFIG_STRING:	return (size_t)k->max;
+		case CONFIG_CHANNELS:	return sizeof(((Config*)0)->probeChannels) + sizeof(int);	// and probeCount
+		case CONFIG_FILTERS:	return sizeof(((Config*)0)->probeFilter) + sizeof(int);	// and probeFilterStages
+		default:		return sizeof(int);
+	}
+}
+
+// Start up only settings are parsed but have no effect until a restart
+static void warn_restart(const Config* running, const Config* config) {
+	for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		const ConfigKey* k = &keys[i];
+		if (!k->live && memcmp((const char*)running + k->offset, (const char*)config + k->offset, field_size(k))) {
+			Log(LOG_LEVEL_INFO, "config : %s.%s changed, takes effect on restart", k->section, k->key);
+		}
+	}
+}
+
+// Swaps in a new configuration.  The one it replaces is never freed:
+// heartThread and acquireThread keep their pointer across cycles to
+// compare with the next one, and a few KB per SIGHUP is nothing.
+static void publish(Config* config) {
+	atomic_store(&current, config);
+}
+
+int ConfigSetup(const char* path) {
+	Config* config = malloc(sizeof(Config));
+	if (config == NULL) {
+		return -1;
+	}
+
+	snprintf(configPath, sizeof(configPath), "%s", path);
+
+	int ret = parse_file(configPath, config);
+	if (ret < 0) {
+		free(config);
+		return -1;
+	}
+	if (ret > 0) {
+		Log(LOG_LEVEL_INFO, "config : %s not found, using defaults", configPath);
+	}
+
+	publish(config);
+	return 0;
+}
+
+int ConfigReload(void) {
+	Config* config = malloc(sizeof(Config));
+	if (config == NULL) {
+		return -1;
+	}
+
+	if (parse_file(configPath, config) != 0) {
+		Log(LOG_LEVEL_WARN, "config : reload of %s failed, keeping the running configuration", configPath);
+		free(config);
+		return -1;
+	}
+
+	warn_restart(ConfigGet(), config);
+	publish(config);
+	return 0;
+}
+
+const Config* ConfigGet(void) {
+	return atomic_load_explicit(&current, memory_order_acquire);
+}
+
+static void write_pairs(FILE* out, const ConfigPair pairs[], const bool done[], int count) {
+	for (int i = 0; i < count; i++) {
+		if (!done[i]) fprintf(out, "%s = %s\n", pairs[i].key, pairs[i].value);
+	}
+}
+
+// Makes a rename in the directory of path durable
+static int sync_dir(const char* path) {
+	char dir[sizeof(configPath)];
+	const char* slash = strrchr(path, '/');
+
+	if (slash == NULL) {
+		snprintf(dir, sizeof(dir), ".");
+	} else {
+		snprintf(dir, sizeof(dir), "%.*s", (slash == path) ? 1 : (int)(slash - path), path);
+	}
+
+	int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	int ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+int ConfigUpdate(const char* section, const ConfigPair pairs[], int count) {
+	char tmpPath[sizeof(configPath) + 8];
+	char line[512] = "";
+	char sectionNow[32] = "general";
+	bool done[count];
+	bool found = false;
+	bool newline = true;	// output ends with a complete line
+
+	memset(done, 0, sizeof(done));
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", configPath);
+
+	// The replacement keeps the mode and owner of the original, a config
+	// kept at 0600 for mqtt.password must not turn world readable
+	FILE* in = fopen(configPath, "r");
+	struct stat st = { .st_mode = 0600, .st_uid = (uid_t)-1, .st_gid = (gid_t)-1 };
+	if (in) fstat(fileno(in), &st);
+
+	int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	FILE* out = NULL;
+	if (fd >= 0 && fchmod(fd, st.st_mode & 07777) == 0) {
+		if (fchown(fd, st.st_uid, st.st_gid) != 0) {
+			Log(LOG_LEVEL_DEBUG, "config : can't keep the owner of %s: %s", configPath, strerror(errno));
+		}
+		out = fdopen(fd, "w");
+	}
+	if (out == NULL) {
+		if (fd >= 0) {
+			close(fd);
+			unlink(tmpPath);
+		}
+		if (in) fclose(in);
+		return -1;
+	}
+
+	while (in && fgets(line, sizeof(line), in)) {
+		char copy[sizeof(line)];
+		strcpy(copy, line);
+
+		char* hash = strchr(copy, '#');
+		if (hash) *hash = '\0';
+		char* text = trim(copy);
+
+		if (*text == '[' && strchr(text, ']')) {
+			// Leaving the section, add what it didn't have before the next one
+			if (!strcmp(sectionNow, section)) {
+				write_pairs(out, pairs, done, count);
+				memset(done, 1, sizeof(done));
+			}
+			*strchr(text, ']') = '\0';
+			snprintf(sectionNow, sizeof(sectionNow), "%s", trim(text + 1));
+			found = found || !strcmp(sectionNow, section);
+		}
+		else if (!strcmp(sectionNow, section) && strchr(text, '=')) {
+			*strchr(text, '=') = '\0';
+			char* key = trim(text);
+			int i;
+			for (i = 0; i < count && strcmp(pairs[i].key, key); i++);
+			if (i < count) {
+				const char* comment = strchr(line, '#');
+				fprintf(out, "%s = %s%s%s", key, pairs[i].value, comment ? "\t" : "\n", comment ? comment : "");
+				done[i] = true;
+				newline = !comment || comment[strlen(comment) - 1] == '\n';
+				continue;
+			}
+		}
+		fputs(line, out);
+		newline = line[strlen(line) - 1] == '\n';
+	}
+	if (in) fclose(in);
+
+	if (!newline) {
+		fputc('\n', out);
+	}
+
+	if (!strcmp(sectionNow, section)) {
+		write_pairs(out, pairs, done, count);
+	} else if (!found) {
+		fprintf(out, "\n[%s]\n", section);
+		write_pairs(out, pairs, done, count);
+	}
+
+	bool ok = fflush(out) == 0 && fsync(fileno(out)) == 0;
+	ok = (fclose(out) == 0) && ok;
+	if (!ok || rename(tmpPath, configPath) != 0) {
+		Log(LOG_LEVEL_ERROR, "config : can't write %s", configPath);
+		unlink(tmpPath);
+		return -1;
+	}
+	if (sync_dir(configPath) != 0) {
+		Log(LOG_LEVEL_WARN, "config : %s written but its directory not synced", configPath);
+	}
+	return 0;
+}
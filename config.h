@@ -0,0 +1,152 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "autotune.h"
+#include "controller.h"
+#include "eta.h"
+#include "fan.h"
+#include "filter.h"
+#include "lid.h"
+#include "log.h"
+#include "mqtt.h"
+#include "plant.h"
+#include "smoker.h"
+#include "state.h"
+
+// Daemon configuration.
+//
+// Settings come from an INI style file, "key = value" lines grouped under
+// [section] headers with # comments.  The active Config is immutable and
+// published through an atomic pointer: a reload parses into a fresh
+// struct and swaps it in, readers simply pick up the new pointer on their
+// next ConfigGet().  A Config stays valid for the life of the process,
+// replaced ones are not freed.  Hardware and HTTP settings are only read at start
+// up, the rest is re-applied by heartThread on its next cycle.
+
+#define CONFIG_DEFAULT_PATH "/etc/bbq.conf"
+
+// How the HTTP daemon schedules connections
+typedef enum {
+	ServerMode_ThreadPerConnection = 0,	// one pthread per client, legacy behaviour
+	ServerMode_Epoll,			// epoll event loop served by a fixed worker pool
+} ServerMode;
+
+typedef enum {
+	TachBackend_Gpiod = 0,
+	TachBackend_WiringPi,
+} TachBackendType;
+
+// One smoker: the pit probe, fan output and controller that hold it at
+// its own target
+typedef struct ZoneConfig {
+	int		controlProbe;		// index of the pit probe driving the fan
+	int		pwmPin;			// wiringPi numbering
+	ControllerType	controllerType;
+	ControllerGains	controllerGains;
+} ZoneConfig;
+
+typedef struct Config {
+	// [general]
+	LogLevel	logLevel;
+	int		logRate;		// lines per second, 0 for no limit
+	int		refreshMs;		// milliseconds between control cycles, 100 or more
+
+	// [probe]
+	int		probeChannels[STATE_MAX_PROBES];	// SPI chip select of each MAX6675
+	int		probeCount;
+	int		probeFaultReads;	// bad pit readings in a row before the fan latches off
+
+	// [filter]
+	FilterConfig	probeFilter[FILTER_MAX_STAGES];
+	int		probeFilterStages;
+
+	// [pwm]
+	int		piFreq;			// PWM base clock in Hz, 0 to detect
+	int		pwmFreq;		// fan PWM frequency in Hz
+
+	// [fan]
+	FanConfig	fan;
+
+	// [tach]
+	int		tachPin;		// wiringPi numbering
+	int		tachPulse;		// pulses per revolution
+	TachBackendType	tachBackend;
+	char		tachGpioChip[64];
+	int		tachGpioLine;		// BCM number of tachPin for the gpiod backend
+	int		tachDebounceUs;
+	int		tachWindowMs;
+	int		tachStallMs;
+	int		tachStallDuty;
+
+	// [zones], zone 0 is set up by probe.control, pwm.pin and [control],
+	// the others by [zone1] and on
+	int		zoneCount;
+	ZoneConfig	zones[STATE_MAX_ZONES];
+
+	// [lid]
+	LidConfig	lid;
+
+	// [plant]
+	PlantConfig	plant;
+
+	// [eta]
+	EtaConfig	eta;
+
+	// [autotune]
+	AutotuneConfig	autotune;
+
+	// [http]
+	int		bindPort;
+	ServerMode	serverMode;
+	int		threadPoolSize;
+	int		keepAlive;
+	int		connectionTimeout;	// seconds
+	int		eventsMaxClients;
+
+	// [mqtt]
+	MqttConfig	mqtt;
+
+	// [rt]
+	int		rtLockMemory;
+	int		rtAcquirePriority;	// SCHED_FIFO priority, 0 for normal scheduling
+	int		rtAcquireCpu;		// core, -1 for any
+	int		rtControlPriority;
+	int		rtControlCpu;
+
+	// [log]
+	char		cookLogPath[256];	// empty to run without a cook log
+	int		cookLogFlushS;
+
+	// [checkpoint]
+	char		checkpointPath[256];	// empty to start cold every time
+	int		checkpointIntervalS;
+	int		checkpointMaxAgeS;	// older checkpoints are ignored, the fan starts off
+
+	// [sim], only read by a make SIM=1 build
+	SmokerConfig	sim;
+} Config;
+
+
+// Loads path on top of the built in defaults and publishes the result.  A
+// missing file at start up leaves the defaults in place.  Returns -1 on a
+// parse error.
+int ConfigSetup(const char* path);
+
+// Re-reads the file given to ConfigSetup.  On error the running
+// configuration is kept.  Returns -1 on error.
+int ConfigReload(void);
+
+const Config* ConfigGet(void);
+
+typedef struct ConfigPair {
+	const char*	key;
+	char		value[32];
+} ConfigPair;
+
+// Writes values into section of the configuration file, replacing the
+// keys already there and adding the rest.  Comments and layout are kept,
+// the file is replaced by rename so a crash leaves the old or the new
+// one.  The running configuration is not touched.  Returns -1 on error.
+int ConfigUpdate(const char* section, const ConfigPair pairs[], int count);
+
+#endif
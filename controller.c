@@ -0,0 +1,168 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "controller.h"
+
+
+#define OUTPUT_MIN 0.0
+#define OUTPUT_MAX 100.0
+#define LEGACY_FULL_BAND 50.0	// degrees below target where the legacy law runs flat out
+
+static double clamp(double value, double lo, double hi) {
+	return (value < lo) ? lo : (value > hi) ? hi : value;
+}
+
+static void legacy_reset(Controller controller, double measurement, double output) {
+	controller->output = output;
+}
+
+static double legacy_step(Controller controller, double setPoint, double measurement, double dt) {
+	double out;
+
+	if (measurement > setPoint) {
+		out = OUTPUT_MIN;
+	} else if (measurement < setPoint - LEGACY_FULL_BAND) {
+		out = OUTPUT_MAX;
+	} else if (setPoint > 0.0) {
+		out = clamp(((setPoint - measurement) * 100.0) / setPoint, OUTPUT_MIN, OUTPUT_MAX);
+	} else {
+		out = OUTPUT_MIN;
+	}
+
+	controller->p = out;
+	controller->i = controller->d = controller->ff = 0.0;
+	return out;
+}
+
+static void pid_reset(Controller controller, double measurement, double output) {
+	controller->prevMeasurement = measurement;
+	controller->output = output;
+	controller->primed = false;
+}
+
+static double pid_step(Controller controller, double setPoint, double measurement, double dt) {
+	const ControllerGains* g = &controller->gains;
+
+	double error = setPoint - measurement;
+	double p = g->kp * error;
+	double ff = (g->kff > 0.0 && setPoint > g->ambient) ? g->kff * (setPoint - g->ambient) : 0.0;
+
+	if (!controller->primed) {
+		// Park the previous output in the integrator so starting or
+		// switching over does not bump the fan
+		controller->integral = clamp(controller->output - p - ff, OUTPUT_MIN, OUTPUT_MAX);
+		controller->prevMeasurement = measurement;
+		controller->primed = true;
+		dt = 0.0;
+	}
+
+	// Derivative on measurement, a set point change does not kick the fan.
+	// No previous measurement right after a restore.
+	double d = (dt > 0.0 && !isnan(controller->prevMeasurement)) ? -g->kd * (measurement - controller->prevMeasurement) / dt : 0.0;
+
+	// Conditional integration: stop winding up while saturated in the
+	// direction the error is pushing
+	double integral = clamp(controller->integral + g->ki * error * dt, OUTPUT_MIN, OUTPUT_MAX);
+	double raw = p + integral + d + ff;
+
+	if ((raw > OUTPUT_MAX && error > 0.0) || (raw < OUTPUT_MIN && error < 0.0)) {
+		integral = controller->integral;
+		raw = p + integral + d + ff;
+	}
+
+	controller->integral = integral;
+	controller->prevMeasurement = measurement;
+
+	controller->p = p;
+	controller->i = integral;
+	controller->d = d;
+	controller->ff = ff;
+
+	return clamp(raw, OUTPUT_MIN, OUTPUT_MAX);
+}
+
+static const ControllerOps controllerOps[CONTROLLER_COUNT] = {
+	[CONTROLLER_LEGACY]	= { "legacy", legacy_reset, legacy_step },
+	[CONTROLLER_PID]	= { "pid", pid_reset, pid_step },
+};
+
+Controller ControllerSetup(ControllerType type, const ControllerGains* gains) {
+	if (type < 0 || type >= CONTROLLER_COUNT) {
+		return 0;
+	}
+
+	Controller controller = (Controller)calloc(1, sizeof(struct Controller));
+
+	if (controller) {
+		controller->type = type;
+		controller->ops = &controllerOps[type];
+		controller->gains = *gains;
+	}
+
+	return controller;
+}
+
+void ControllerFree(Controller controller) {
+	if (controller) {
+		free(controller);
+	}
+}
+
+bool ControllerSetType(Controller controller, ControllerType type) {
+	if (controller == 0 || type < 0 || type >= CONTROLLER_COUNT) {
+		return false;
+	}
+
+	if (controller->type != type) {
+		controller->type = type;
+		controller->ops = &controllerOps[type];
+		controller->primed = false;
+	}
+	return true;
+}
+
+void ControllerSetGains(Controller controller, const ControllerGains* gains) {
+	if (controller) {
+		controller->gains = *gains;
+	}
+}
+
+const char* ControllerName(ControllerType type) {
+	if (type < 0 || type >= CONTROLLER_COUNT) {
+		return "unknown";
+	}
+	return controllerOps[type].name;
+}
+
+void ControllerReset(Controller controller, double measurement, double output) {
+	if (controller) {
+		controller->ops->reset(controller, measurement, output);
+	}
+}
+
+void ControllerRestore(Controller controller, double integral, double output) {
+	if (controller) {
+		controller->integral = clamp(integral, OUTPUT_MIN, OUTPUT_MAX);
+		controller->i = controller->integral;
+		controller->output = clamp(output, OUTPUT_MIN, OUTPUT_MAX);
+		controller->prevMeasurement = NAN;
+		controller->primed = true;
+	}
+}
+
+void ControllerTrack(Controller controller, double output) {
+	if (controller && output < controller->output) {
+		controller->integral = clamp(controller->integral - (controller->output - output), OUTPUT_MIN, OUTPUT_MAX);
+		controller->i = controller->integral;
+		controller->output = output;
+	}
+}
+
+double ControllerStep(Controller controller, double setPoint, double measurement, double dt) {
+	if (controller == 0) {
+		return OUTPUT_MIN;
+	}
+
+	controller->output = controller->ops->step(controller, setPoint, measurement, dt);
+	return controller->output;
+}
@@ -0,0 +1,73 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <stdbool.h>
+
+// Fan controllers.
+//
+// Every controller maps a set point and a measured pit temperature onto a
+// fan duty in percent (0-100).  The behaviour lives behind a table of
+// function pointers so heartThread can switch between them at runtime.
+
+typedef enum {
+	CONTROLLER_LEGACY,	// proportional to the distance from target, the original fan law
+	CONTROLLER_PID,		// PID with anti-windup, derivative on measurement and feed-forward
+	CONTROLLER_COUNT
+} ControllerType;
+
+typedef struct ControllerGains {
+	double	kp;		// % per degree of error
+	double	ki;		// % per degree second of error
+	double	kd;		// % per degree per second of measurement change
+	double	kff;		// % per degree of set point above ambient, 0 disables feed-forward
+	double	ambient;	// degrees, base line for the feed-forward term
+} ControllerGains;
+
+struct Controller;
+
+typedef struct ControllerOps {
+	const char*	name;
+	// Bumpless start: seed the internal state so the next step returns output
+	void	(*reset)(struct Controller* controller, double measurement, double output);
+	double	(*step)(struct Controller* controller, double setPoint, double measurement, double dt);
+} ControllerOps;
+
+typedef struct Controller {
+	ControllerType		type;
+	const ControllerOps*	ops;
+	ControllerGains		gains;
+
+	double	integral;
+	double	prevMeasurement;
+	bool	primed;
+
+	// Terms of the last step, reported through /status
+	double	p;
+	double	i;
+	double	d;
+	double	ff;
+	double	output;
+} *Controller;
+
+
+Controller ControllerSetup(ControllerType type, const ControllerGains* gains);
+void ControllerFree(Controller controller);
+
+// Switches algorithm keeping the current output, returns false for an unknown type
+bool ControllerSetType(Controller controller, ControllerType type);
+void ControllerSetGains(Controller controller, const ControllerGains* gains);
+
+const char* ControllerName(ControllerType type);
+
+void ControllerReset(Controller controller, double measurement, double output);
+double ControllerStep(Controller controller, double setPoint, double measurement, double dt);
+
+// Carries on from a checkpoint: integrator and output as they were, the
+// derivative starting over from the next measurement
+void ControllerRestore(Controller controller, double integral, double output);
+
+// The last output was cut to output downstream, pulls the integrator back
+// by the difference so it doesn't wind up against the cut
+void ControllerTrack(Controller controller, double output);
+
+#endif
@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cooklog.h"
+#include "log.h"
+
+
+#define COOKLOG_BATCH 600	// samples per write
+
+static int fd = -1;
+static uint32_t cursor;		// next 1 s history sample to write
+static off_t end;		// file size up to the last whole record written
+static int interval;
+static bool stopping;
+static pthread_t flushTid;
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static HistorySample batch[COOKLOG_BATCH];
+
+static bool write_all(const void* data, size_t len) {
+	const char* p = data;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+// Validates the header, returns the number of whole records in the file
+// or -1 if the file is not a compatible log
+static long check_file(off_t size) {
+	CookLogHeader header;
+
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header)
+		|| memcmp(header.magic, COOKLOG_MAGIC, sizeof(header.magic))
+		|| header.version != COOKLOG_VERSION
+		|| header.recordSize != sizeof(HistorySample)) {
+		return -1;
+	}
+
+	long records = (size - sizeof(header)) / sizeof(HistorySample);
+	off_t whole = sizeof(header) + (off_t)records * sizeof(HistorySample);
+
+	if (whole != size && ftruncate(fd, whole) != 0) {
+		return -1;
+	}
+	return records;
+}
+
+// Rebuilds the history from the newest records by mapping only the tail
+static void restore(long records) {
+	long keep = HistoryRestoreCapacity();
+	if (records <= 0) {
+		return;
+	}
+	if (keep > records) {
+		keep = records;
+	}
+
+	long page = sysconf(_SC_PAGESIZE);
+	off_t first = sizeof(CookLogHeader) + (off_t)(records - keep) * sizeof(HistorySample);
+	off_t mapAt = first - first % page;
+	size_t mapLen = (first - mapAt) + keep * sizeof(HistorySample);
+
+	void* map = mmap(NULL, mapLen, PROT_READ, MAP_PRIVATE, fd, mapAt);
+	if (map == MAP_FAILED) {
+		Log(LOG_LEVEL_WARN, "cook log : mmap failed, starting with empty history");
+		return;
+	}
+
+	HistoryRestore((const HistorySample*)((const char*)map + (first - mapAt)), keep);
+	munmap(map, mapLen);
+}
+
+static void flush_locked(void) {
+	uint32_t next;
+	int n;
+
+	if (fd < 0) {
+		return;
+	}
+
+	bool wrote = false;
+	while ((n = HistoryRead(0, cursor, batch, COOKLOG_BATCH, &next)) > 0) {
+		if (!write_all(batch, n * sizeof(HistorySample))) {
+			int err = errno;
+			// Drop the part of the batch that made it, the retry appends
+			// all of it again and would land off the record boundary
+			if (ftruncate(fd, end) != 0) {
+				Log(LOG_LEVEL_WARN, "cook log : can't trim a partial write: %s", strerror(errno));
+			}
+			Log(LOG_LEVEL_WARN, "cook log : write failed: %s", strerror(err));
+			return;
+		}
+		end += n * sizeof(HistorySample);
+		cursor = next;
+		wrote = true;
+	}
+
+	if (wrote) fdatasync(fd);
+}
+
+static void* flush_thread(void* arg) {
+	bool last = false;
+
+	pthread_mutex_lock(&logLock);
+	while (!last) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += interval;
+
+		while (!stopping && pthread_cond_timedwait(&wake, &logLock, &deadline) != ETIMEDOUT) {
+		}
+		// Closing always gets one final flush
+		last = stopping;
+		flush_locked();
+	}
+	pthread_mutex_unlock(&logLock);
+
+	return arg;
+}
+
+int CookLogSetup(const char* path, int flushSeconds) {
+	struct stat st;
+
+	fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		Log(LOG_LEVEL_WARN, "cook log : can't open %s: %s", path, strerror(errno));
+		if (fd >= 0) close(fd);
+		fd = -1;
+		return -1;
+	}
+
+	long records = 0;
+	if (st.st_size == 0) {
+		CookLogHeader header = { COOKLOG_MAGIC, COOKLOG_VERSION, sizeof(HistorySample), HistoryProbes(), 0 };
+		if (!write_all(&header, sizeof(header)) || fdatasync(fd) != 0) {
+			Log(LOG_LEVEL_WARN, "cook log : can't write header to %s", path);
+			close(fd);
+			fd = -1;
+			return -1;
+		}
+	} else if ((records = check_file(st.st_size)) < 0) {
+		Log(LOG_LEVEL_WARN, "cook log : %s is not a compatible log", path);
+		close(fd);
+		fd = -1;
+		return -1;
+	}
+
+	restore(records);
+	cursor = HistoryCursor(0);
+	end = sizeof(CookLogHeader) + (off_t)records * sizeof(HistorySample);
+
+	interval = (flushSeconds > 0) ? flushSeconds : 1;
+	stopping = false;
+	if (pthread_create(&flushTid, NULL, flush_thread, NULL) != 0) {
+		close(fd);
+		fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+void CookLogFlush(void) {
+	pthread_mutex_lock(&logLock);
+	flush_locked();
+	pthread_mutex_unlock(&logLock);
+}
+
+void CookLogClose(void) {
+	if (fd < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&logLock);
+	stopping = true;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&logLock);
+	pthread_join(flushTid, NULL);
+
+	close(fd);
+	fd = -1;
+}
@@ -0,0 +1,38 @@
+#ifndef COOKLOG_H
+#define COOKLOG_H
+
+#include <stdint.h>
+
+#include "history.h"
+
+// Append only binary cook log.
+//
+// The file is a CookLogHeader followed by fixed size HistorySample
+// records at 1 s resolution.  A background thread appends whatever the
+// history gained since the last flush with a single write and fdatasync,
+// so the SD card sees one small write per flush interval.  A torn record
+// at the end of the file, left by a crash, is cut off when it is opened.
+
+#define COOKLOG_MAGIC   "BBQLOG\0\0"
+#define COOKLOG_VERSION 1
+
+typedef struct CookLogHeader {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	recordSize;	// sizeof(HistorySample) of the writer
+	uint32_t	probes;		// probes in use when the file was created
+	uint32_t	reserved;
+} CookLogHeader;
+
+
+// Opens or creates the log, rebuilds the history rings from its tail and
+// starts the flush thread.  Returns -1 if the log could not be used.
+int CookLogSetup(const char* path, int flushSeconds);
+
+// Writes out pending samples now
+void CookLogFlush(void);
+
+// Final flush, stops the thread and closes the file
+void CookLogClose(void);
+
+#endif
@@ -0,0 +1,111 @@
+#include <math.h>
+#include <string.h>
+
+#include "eta.h"
+
+
+#define ETA_MIN_UPDATES	10	// fit updates before an estimate is given
+#define ETA_P_INIT	1.0	// initial covariance, large next to k ~ 1e-4 and c ~ 1e-3
+
+static void reset_fit(Eta* eta) {
+	eta->theta[0] = eta->theta[1] = 0.0;
+	eta->P[0][0] = eta->P[1][1] = ETA_P_INIT;
+	eta->P[0][1] = eta->P[1][0] = 0.0;
+	eta->updates = 0;
+}
+
+void EtaSetup(Eta* eta, const EtaConfig* config) {
+	memset(eta, 0, sizeof(*eta));
+	eta->config = *config;
+	eta->prevTemp = NAN;
+	eta->seconds = -1.0;
+	reset_fit(eta);
+}
+
+void EtaConfigure(Eta* eta, const EtaConfig* config) {
+	eta->config = *config;
+}
+
+// One RLS step for rate = k x - c with x = pit - T
+static void update_fit(Eta* eta, double x, double rate) {
+	const double phi[2] = { x, -1.0 };
+	double lambda = eta->config.forgetting;
+
+	double Pphi[2] = {
+		eta->P[0][0] * phi[0] + eta->P[0][1] * phi[1],
+		eta->P[1][0] * phi[0] + eta->P[1][1] * phi[1],
+	};
+	double denom = lambda + phi[0] * Pphi[0] + phi[1] * Pphi[1];
+	double gain[2] = { Pphi[0] / denom, Pphi[1] / denom };
+	double error = rate - (eta->theta[0] * phi[0] + eta->theta[1] * phi[1]);
+
+	eta->theta[0] += gain[0] * error;
+	eta->theta[1] += gain[1] * error;
+
+	// P = (P - gain phi' P) / lambda, P stays symmetric
+	for (int i = 0; i < 2; i++) {
+		for (int j = 0; j < 2; j++) {
+			eta->P[i][j] = (eta->P[i][j] - gain[i] * Pphi[j]) / lambda;
+		}
+	}
+	eta->updates++;
+}
+
+static double estimate(const Eta* eta) {
+	const EtaConfig* config = &eta->config;
+	double k = eta->theta[0];
+	double c = eta->theta[1];
+
+	if (eta->temp >= config->doneTemp) {
+		return 0.0;
+	}
+	if (eta->updates < ETA_MIN_UPDATES || eta->stalled || k <= 0.0) {
+		return -1.0;
+	}
+
+	double equilibrium = eta->pit - c / k;
+	if (equilibrium <= config->doneTemp) {
+		return -1.0;
+	}
+	return log((equilibrium - eta->temp) / (equilibrium - config->doneTemp)) / k;
+}
+
+void EtaPush(Eta* eta, double temp, double pit, double dt) {
+	const EtaConfig* config = &eta->config;
+
+	if (isnan(temp) || isnan(pit)) {
+		return;
+	}
+
+	eta->sumTemp += temp;
+	eta->sumPit += pit;
+	eta->elapsed += dt;
+	eta->samples++;
+
+	if (eta->elapsed < config->intervalS) {
+		return;
+	}
+
+	double interval = eta->elapsed;
+	eta->temp = eta->sumTemp / eta->samples;
+	eta->pit = eta->sumPit / eta->samples;
+	eta->sumTemp = eta->sumPit = eta->elapsed = 0.0;
+	eta->samples = 0;
+
+	if (!isnan(eta->prevTemp)) {
+		eta->rate = (eta->temp - eta->prevTemp) / interval;
+		update_fit(eta, eta->pit - eta->temp, eta->rate);
+	}
+	eta->prevTemp = eta->temp;
+
+	// Coming out of the stall the loss term collapses, refit from scratch
+	// rather than unlearn hours of stall
+	bool stalled = eta->temp >= config->stallLow && eta->temp <= config->stallHigh
+		&& eta->rate * 3600.0 < config->stallRate;
+	if (eta->stalled && !stalled) {
+		reset_fit(eta);
+	}
+	eta->stalled = stalled;
+
+	eta->seconds = estimate(eta);
+}
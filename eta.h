@@ -0,0 +1,59 @@
+#ifndef ETA_H
+#define ETA_H
+
+#include <stdbool.h>
+
+// Meat probe done time estimate.
+//
+// The meat heats towards the pit by Newton's law, less a loss that stands
+// for evaporation at the surface:
+//
+//	dT/dt = k (pit - T) - c
+//
+// k and c are fitted by recursive least squares with forgetting, one
+// update per interval from the averaged samples, so each sample costs a
+// couple of additions however long the cook.  The meat then settles at
+// pit - c / k and reaches the done temperature after
+// ln((Teq - T) / (Teq - done)) / k seconds.  In the stall evaporation
+// balances the heat coming in and no estimate is given.
+
+typedef struct EtaConfig {
+	double	doneTemp;	// degrees the meat is done at
+	int	intervalS;	// seconds of samples averaged into one fit update
+	double	forgetting;	// RLS forgetting factor per update, 0 - 1
+	double	stallLow;	// degrees the stall is looked for between
+	double	stallHigh;
+	double	stallRate;	// degrees per hour below which the meat counts as stalled
+} EtaConfig;
+
+typedef struct Eta {
+	EtaConfig	config;
+
+	// Samples of the interval in progress
+	double	sumTemp;
+	double	sumPit;
+	double	elapsed;
+	int	samples;
+
+	double	prevTemp;	// average of the last interval, NAN before the first
+	double	temp;
+	double	pit;
+	double	rate;		// degrees per second over the last interval
+
+	// RLS state, theta = (k, c)
+	double	theta[2];
+	double	P[2][2];
+	int	updates;
+
+	bool	stalled;
+	double	seconds;	// estimate, < 0 when there is none
+} Eta;
+
+
+void EtaSetup(Eta* eta, const EtaConfig* config);
+void EtaConfigure(Eta* eta, const EtaConfig* config);
+
+// Feeds a meat and a pit temperature dt seconds after the last sample
+void EtaPush(Eta* eta, double temp, double pit, double dt);
+
+#endif
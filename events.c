@@ -0,0 +1,200 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "events.h"
+#include "state.h"
+#include "status.h"
+
+
+#define EVENT_MAX_LEN     1100
+#define EVENT_KEEPALIVE_S 15	// comment line sent by idle thread per connection clients
+
+typedef struct EventsClient {
+	struct MHD_Connection*	conn;
+	unsigned int		version;	// last state version sent
+	bool			suspended;
+	char			buf[EVENT_MAX_LEN];
+	size_t			len;
+	size_t			off;
+	struct EventsClient*	next;
+} EventsClient;
+
+static pthread_mutex_t clientsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t published = PTHREAD_COND_INITIALIZER;
+static EventsClient* clients = NULL;
+static int clientCount = 0;
+static int clientLimit = 8;
+static bool useSuspend = true;
+static bool closing = false;		// under clientsLock
+
+void EventsSetup(bool suspendResume, int maxClients) {
+	useSuspend = suspendResume;
+	clientLimit = maxClients;
+}
+
+// Renders the next event into the client buffer, false if there is nothing new
+static bool render_event(EventsClient* client) {
+	BBQState state;
+	unsigned int version = StateRead(&state);
+
+	if (version == 0 || version == client->version) {
+		return false;
+	}
+
+	memcpy(client->buf, "data: ", 6);
+	int len = StatusRender(client->buf + 6, sizeof(client->buf) - 8, &state);
+	if (len < 0) {
+		return false;
+	}
+
+	memcpy(client->buf + 6 + len, "\n\n", 2);
+	client->len = 6 + len + 2;
+	client->off = 0;
+	client->version = version;
+	return true;
+}
+
+// Blocks a thread per connection client until a new version or the keep alive
+static void wait_for_version(EventsClient* client) {
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += EVENT_KEEPALIVE_S;
+
+	pthread_mutex_lock(&clientsLock);
+	while (!closing && !render_event(client)) {
+		if (pthread_cond_timedwait(&published, &clientsLock, &deadline) == ETIMEDOUT) {
+			static const char ping[] = ": ping\n\n";
+			memcpy(client->buf, ping, sizeof(ping) - 1);
+			client->len = sizeof(ping) - 1;
+			client->off = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&clientsLock);
+}
+
+static ssize_t event_reader(void* cls, uint64_t pos, char* buf, size_t max) {
+	EventsClient* client = cls;
+
+	if (client->off >= client->len && !render_event(client)) {
+		if (!useSuspend) {
+			wait_for_version(client);
+		} else {
+			// Re-check under the lock so a notify between the two cannot be lost
+			pthread_mutex_lock(&clientsLock);
+			bool ready = closing || render_event(client);
+			if (!ready) {
+				client->suspended = true;
+				MHD_suspend_connection(client->conn);
+			}
+			pthread_mutex_unlock(&clientsLock);
+			if (!ready) {
+				return 0;
+			}
+		}
+		// Closing with nothing left to send
+		if (client->off >= client->len) {
+			return MHD_CONTENT_READER_END_OF_STREAM;
+		}
+	}
+
+	size_t n = client->len - client->off;
+	if (n > max) {
+		n = max;
+	}
+	memcpy(buf, client->buf + client->off, n);
+	client->off += n;
+	return n;
+}
+
+static void event_free(void* cls) {
+	EventsClient* client = cls;
+
+	pthread_mutex_lock(&clientsLock);
+	for (EventsClient** p = &clients; *p; p = &(*p)->next) {
+		if (*p == client) {
+			*p = client->next;
+			clientCount--;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&clientsLock);
+
+	free(client);
+}
+
+int EventsQueue(struct MHD_Connection* conn) {
+	pthread_mutex_lock(&clientsLock);
+	bool full = closing || clientCount >= clientLimit;
+	pthread_mutex_unlock(&clientsLock);
+
+	if (full) {
+		return StatusQueueResponse(conn, MHD_HTTP_SERVICE_UNAVAILABLE,
+			MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT));
+	}
+
+	EventsClient* client = calloc(1, sizeof(EventsClient));
+	if (client == NULL) {
+		return MHD_NO;
+	}
+	client->conn = conn;
+
+	struct MHD_Response* res = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, EVENT_MAX_LEN,
+		&event_reader, client, &event_free);
+	if (res == NULL) {
+		free(client);
+		return MHD_NO;
+	}
+	MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE, "text/event-stream");
+	MHD_add_response_header(res, MHD_HTTP_HEADER_CACHE_CONTROL, "no-cache");
+
+	pthread_mutex_lock(&clientsLock);
+	client->next = clients;
+	clients = client;
+	clientCount++;
+	pthread_mutex_unlock(&clientsLock);
+
+	return StatusQueueResponse(conn, MHD_HTTP_OK, res);
+}
+
+// Resumes every suspended client, their readers then render or end
+static void resume_all(void) {
+	struct MHD_Connection* resume[64];
+	int n;
+
+	do {
+		n = 0;
+
+		// A suspended connection cannot be closed by MHD, so it is safe to
+		// resume outside the lock once unmarked
+		pthread_mutex_lock(&clientsLock);
+		for (EventsClient* c = clients; c && n < 64; c = c->next) {
+			if (c->suspended) {
+				c->suspended = false;
+				resume[n++] = c->conn;
+			}
+		}
+		pthread_cond_broadcast(&published);
+		pthread_mutex_unlock(&clientsLock);
+
+		for (int i = 0; i < n; i++) {
+			MHD_resume_connection(resume[i]);
+		}
+	} while (n == 64);
+}
+
+void EventsNotify(void) {
+	resume_all();
+}
+
+void EventsClose(void) {
+	pthread_mutex_lock(&clientsLock);
+	closing = true;
+	pthread_mutex_unlock(&clientsLock);
+
+	resume_all();
+}
@@ -0,0 +1,28 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdbool.h>
+
+#include <microhttpd.h>
+
+// /events Server-Sent Events stream.
+//
+// Each client gets a callback response that emits one "data:" event per
+// published state version.  With an event loop daemon a client with
+// nothing to send is suspended and EventsNotify resumes it; with a thread
+// per connection the client thread waits on a condition instead.
+
+void EventsSetup(bool suspendResume, int maxClients);
+
+// Queues the stream response, 503 once maxClients are connected
+int EventsQueue(struct MHD_Connection* conn);
+
+// Called by heartThread after a new state version was published
+void EventsNotify(void);
+
+// Ends every stream and turns new clients away.  MHD_stop_daemon aborts
+// while a connection is still suspended, so this goes first, once
+// heartThread has stopped calling EventsNotify.
+void EventsClose(void);
+
+#endif
@@ -0,0 +1,98 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "fan.h"
+#include "hal.h"
+
+
+#define NSEC_PER_MSEC 1000000ULL
+
+Fan FanSetup(int pin, int range, const FanConfig* config) {
+	Fan fan = calloc(1, sizeof(struct Fan));
+	if (fan == NULL) {
+		return NULL;
+	}
+
+	fan->pin = pin;
+	fan->range = range;
+	fan->config = *config;
+	return fan;
+}
+
+void FanFree(Fan fan) {
+	free(fan);
+}
+
+void FanConfigure(Fan fan, const FanConfig* config) {
+	fan->config = *config;
+}
+
+void FanKick(Fan fan) {
+	fan->output = 0.0;
+}
+
+// Moves the level towards duty by at most the slew limit, and not at all
+// for a change inside the deadband
+static double track(Fan fan, double duty, uint64_t now) {
+	const FanConfig* config = &fan->config;
+	double level = fan->level;
+
+	if (duty == 0.0 || level == 0.0) {
+		fan->direction = 0;
+		return duty;
+	}
+
+	double change = duty - level;
+	int direction = (change > 0.0) - (change < 0.0);
+	double band = (direction != fan->direction && fan->direction != 0 && config->hysteresis > 0.0)
+		? config->hysteresis : config->deadband;
+
+	if (direction == 0 || fabs(change) <= band) {
+		if (direction != 0) fan->held++;
+		return level;
+	}
+	fan->direction = direction;
+
+	if (config->slewRate > 0.0 && fan->lastSet != 0) {
+		double step = config->slewRate * (now - fan->lastSet) / 1e9;
+		duty = fmin(fmax(duty, level - step), level + step);
+	}
+	return duty;
+}
+
+double FanSet(Fan fan, double duty) {
+	const FanConfig* config = &fan->config;
+	double output = isnan(duty) ? 0.0 : (duty > 100.0) ? 100.0 : (duty < 0.0) ? 0.0 : duty;
+	uint64_t now = HalNow();
+
+	output = track(fan, output, now);
+	fan->level = output;
+	fan->lastSet = now;
+
+	if (output > 0.0) {
+		// Starting from standstill, hold the kick duty for kickMs
+		if (fan->output == 0.0 && config->kickDuty > 0.0 && config->kickMs > 0) {
+			fan->kickUntil = now + config->kickMs * NSEC_PER_MSEC;
+		}
+		if (fan->kickUntil != 0 && now < fan->kickUntil) {
+			output = fmax(output, config->kickDuty);
+		} else {
+			fan->kickUntil = 0;
+		}
+
+		output = fmax(output, config->minDuty);
+		output = fmin(output, 100.0);
+	} else {
+		fan->kickUntil = 0;
+	}
+
+	int counts = lround(fan->range * output / 100.0);
+	if (counts != fan->counts) {
+		HalPwmWrite(fan->pin, counts);
+		fan->counts = counts;
+		fan->writes++;
+	}
+
+	fan->output = output;
+	return output;
+}
@@ -0,0 +1,54 @@
+#ifndef FAN_H
+#define FAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hardware PWM fan output.
+//
+// Duty is a continuous percentage mapped onto the full PWM range rather
+// than whole percent steps.  Fans that stall at low duty are held at a
+// minimum spin while running, and started from standstill with a short
+// kick at a higher duty.  Between those the output is slew limited and
+// deadbanded so a noisy controller doesn't rewrite the register, and hunt
+// audibly, every cycle.  Stopping and starting bypass both.
+
+typedef struct FanConfig {
+	double	minDuty;	// % a running fan is held at or above, 0 to disable
+	double	kickDuty;	// % a stopped fan is started at, 0 to disable
+	int	kickMs;		// kick duty is held at least this long
+	double	deadband;	// % a change must exceed to be applied, 0 to disable
+	double	hysteresis;	// % a change reversing the last move must exceed, 0 to use deadband
+	double	slewRate;	// % per second the output may move, 0 for no limit
+} FanConfig;
+
+typedef struct Fan {
+	int		pin;
+	int		range;		// PWM counts at 100%
+	FanConfig	config;
+
+	double		level;		// % after slew and deadband, before minimum spin
+	int		direction;	// sign of the last applied move
+	uint64_t	lastSet;	// monotonic ns of the last FanSet
+	double		output;		// % on the pin
+	int		counts;		// last value written
+	uint64_t	kickUntil;	// monotonic ns, 0 when not kicking
+	unsigned long	writes;
+	unsigned long	held;		// changes swallowed by the deadband
+} *Fan;
+
+
+// The pin must already be set up for PWM with range counts per period
+Fan FanSetup(int pin, int range, const FanConfig* config);
+void FanFree(Fan fan);
+
+void FanConfigure(Fan fan, const FanConfig* config);
+
+// Drives the fan at duty % (0-100) and returns the duty actually applied
+// after slew limit, deadband, minimum spin and kick start
+double FanSet(Fan fan, double duty);
+
+// Kicks the fan on the next FanSet, e.g. after a stall
+void FanKick(Fan fan);
+
+#endif
@@ -0,0 +1,166 @@
+#include <math.h>
+#include <string.h>
+
+#include "filter.h"
+
+
+void FilterSetup(Filter* filter, const FilterConfig* config) {
+	filter->config = *config;
+
+	if (filter->config.type < 0 || filter->config.type >= FILTER_COUNT) {
+		filter->config.type = FILTER_NONE;
+	}
+	if (filter->config.taps < 1) {
+		filter->config.taps = 1;
+	} else if (filter->config.taps > FILTER_MAX_TAPS) {
+		filter->config.taps = FILTER_MAX_TAPS;
+	}
+	if (!(filter->config.alpha > 0.0 && filter->config.alpha <= 1.0)) {
+		filter->config.alpha = 1.0;
+	}
+
+	FilterReset(filter);
+}
+
+void FilterReset(Filter* filter) {
+	filter->head = 0;
+	filter->fill = 0;
+	filter->sum = 0.0;
+	filter->ema = 0.0;
+}
+
+static float median(const Filter* filter) {
+	float sorted[FILTER_MAX_TAPS];
+	int n = filter->fill;
+
+	memcpy(sorted, filter->ring, sizeof(float) * n);
+
+	// insertion sort, the window is at most FILTER_MAX_TAPS long
+	for (int i = 1; i < n; i++) {
+		float v = sorted[i];
+		int j = i - 1;
+		while (j >= 0 && sorted[j] > v) {
+			sorted[j + 1] = sorted[j];
+			j--;
+		}
+		sorted[j + 1] = v;
+	}
+
+	return (n & 1) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0f;
+}
+
+float FilterPush(Filter* filter, float sample) {
+	const int taps = filter->config.taps;
+
+	switch(filter->config.type) {
+		case FILTER_AVERAGE:
+		case FILTER_MEDIAN:
+			if (filter->fill == taps) {
+				filter->sum -= filter->ring[filter->head];
+			} else {
+				filter->fill++;
+			}
+			filter->ring[filter->head] = sample;
+			filter->sum += sample;
+			filter->head = (filter->head + 1) % taps;
+
+			if (filter->config.type == FILTER_MEDIAN) {
+				return median(filter);
+			}
+
+			// Re-add the window once per lap so rounding cannot accumulate
+			if (filter->head == 0) {
+				filter->sum = 0.0;
+				for (int i = 0; i < filter->fill; i++) {
+					filter->sum += filter->ring[i];
+				}
+			}
+			return filter->sum / filter->fill;
+
+		case FILTER_EMA:
+			if (filter->fill == 0) {
+				filter->ema = sample;
+				filter->fill = 1;
+			} else {
+				filter->ema += filter->config.alpha * (sample - filter->ema);
+			}
+			return filter->ema;
+
+		default:
+			return sample;
+	}
+}
+
+void FilterChainSetup(FilterChain* chain, const FilterConfig configs[], int count) {
+	chain->stages = (count > FILTER_MAX_STAGES) ? FILTER_MAX_STAGES : (count < 0) ? 0 : count;
+
+	for (int i = 0; i < chain->stages; i++) {
+		FilterSetup(&chain->stage[i], &configs[i]);
+	}
+}
+
+void FilterChainReset(FilterChain* chain) {
+	for (int i = 0; i < chain->stages; i++) {
+		FilterReset(&chain->stage[i]);
+	}
+}
+
+float FilterChainPush(FilterChain* chain, float sample) {
+	for (int i = 0; i < chain->stages; i++) {
+		sample = FilterPush(&chain->stage[i], sample);
+	}
+	return sample;
+}
+
+static bool filter_valid(const Filter* filter) {
+	const int taps = filter->config.taps;
+
+	switch(filter->config.type) {
+		case FILTER_AVERAGE:
+		case FILTER_MEDIAN:
+			if (taps < 1 || taps > FILTER_MAX_TAPS
+				|| filter->fill < 0 || filter->fill > taps
+				|| filter->head < 0 || filter->head >= taps
+				|| (filter->fill < taps && filter->head != filter->fill)
+				|| !isfinite(filter->sum)) {
+				return false;
+			}
+			for (int i = 0; i < filter->fill; i++) {
+				if (!isfinite(filter->ring[i])) {
+					return false;
+				}
+			}
+			return true;
+
+		case FILTER_EMA:
+			return (filter->fill == 0 || filter->fill == 1) && isfinite(filter->ema)
+				&& filter->config.alpha > 0.0 && filter->config.alpha <= 1.0;
+
+		case FILTER_NONE:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+bool FilterChainValid(const FilterChain* chain) {
+	if (chain->stages < 0 || chain->stages > FILTER_MAX_STAGES) {
+		return false;
+	}
+	for (int i = 0; i < chain->stages; i++) {
+		if (!filter_valid(&chain->stage[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const char* FilterName(FilterType type) {
+	static const char* names[FILTER_COUNT] = { "none", "average", "median", "ema" };
+
+	if (type < 0 || type >= FILTER_COUNT) {
+		return "unknown";
+	}
+	return names[type];
+}
@@ -0,0 +1,58 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+
+// Probe reading filters.
+//
+// Each stage keeps its history in a fixed ring inside the struct, so
+// pushing a sample never allocates.  Stages are chained, typically a
+// median for spike rejection followed by an average or EMA to smooth.
+
+#define FILTER_MAX_TAPS   15
+#define FILTER_MAX_STAGES 3
+
+typedef enum {
+	FILTER_NONE,
+	FILTER_AVERAGE,		// moving average over taps samples
+	FILTER_MEDIAN,		// median of the last taps samples
+	FILTER_EMA,		// exponential moving average with weight alpha
+	FILTER_COUNT
+} FilterType;
+
+typedef struct FilterConfig {
+	FilterType	type;
+	int		taps;	// window for AVERAGE and MEDIAN, 1 - FILTER_MAX_TAPS
+	double		alpha;	// weight of a new sample for EMA, 0 - 1
+} FilterConfig;
+
+typedef struct Filter {
+	FilterConfig	config;
+	float		ring[FILTER_MAX_TAPS];
+	int		head;
+	int		fill;
+	double		sum;
+	double		ema;
+} Filter;
+
+typedef struct FilterChain {
+	int	stages;
+	Filter	stage[FILTER_MAX_STAGES];
+} FilterChain;
+
+
+void FilterSetup(Filter* filter, const FilterConfig* config);
+void FilterReset(Filter* filter);
+float FilterPush(Filter* filter, float sample);
+
+void FilterChainSetup(FilterChain* chain, const FilterConfig configs[], int count);
+void FilterChainReset(FilterChain* chain);
+float FilterChainPush(FilterChain* chain, float sample);
+
+// False if the history of a chain read back from outside is inconsistent
+// with its own config, pushing to it would then index off the ring
+bool FilterChainValid(const FilterChain* chain);
+
+const char* FilterName(FilterType type);
+
+#endif
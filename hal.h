@@ -0,0 +1,57 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "smoker.h"
+
+// Hardware abstraction.
+//
+// Everything the daemon touches on the Pi goes through here: the SPI bus,
+// the PWM pins, the tach edge interrupt and the clock the control loop runs
+// on.  hal_wiringpi.c drives the real thing.  hal_sim.c, built with
+// make SIM=1, answers the same calls from a simulated smoker on a virtual
+// clock, so the whole daemon runs on any Linux box and faster than real
+// time.
+
+// sim configures the simulated backend, hardware ignores it.  -1 on error.
+int HalSetup(const SmokerConfig* sim);
+
+// true on a board whose PWM clock runs at 54 MHz, for when the device
+// tree doesn't say
+bool HalBoardPi4(void);
+
+int HalSpiSetup(int channel, int speed);
+// Full duplex transfer in place, returns the bytes transferred or -1
+int HalSpiTransfer(int channel, unsigned char* data, int len);
+
+// Mark-space PWM on pin, starting at 0.  The Pi has two channels sharing
+// one clock and range, -1 if pin is on neither or its channel is taken.
+int HalPwmSetup(int pin, int clock, int range);
+
+// Software PWM on any pin, a thread toggling it in 100 us steps.  -1 on error.
+int HalSoftPwmSetup(int pin, int range);
+
+// Either kind of PWM pin
+void HalPwmWrite(int pin, int value);
+
+// Input with a pull down, what an unused output is left as
+void HalPinRelease(int pin);
+
+// Calls edge for every rising edge on pin with its HalNow() time stamp.
+// One pin at a time.  Returns -1 if the interrupt can't be set up.
+int HalEdgeIsr(int pin, void (*edge)(uint64_t ns));
+
+// CLOCK_MONOTONIC in ns on hardware, the simulation clock under SIM
+uint64_t HalNow(void);
+void HalSleepUntil(uint64_t ns);
+
+// Wall clock seconds, moves with HalNow() under SIM
+time_t HalTime(void);
+
+// Simulated backend only: a copy of the model behind the readings
+void HalSimRead(Smoker* smoker);
+
+#endif
@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "hal.h"
+#include "log.h"
+
+
+// Simulated backend.  The virtual clock only moves in HalSleepUntil, which
+// the control loop's Ticker calls once per cycle: the smoker is stepped up
+// to the deadline with the last PWM value, tach edges are generated at
+// their exact times in between, and with speed > 0 the call also sleeps
+// the real time the step stands for.  A MAX6675 read encodes the model
+// temperature of its channel the way the chip would.  There is one
+// smoker, blown by the first PWM pin set up; any other pin is accepted
+// and goes nowhere.
+
+#define SIM_START_NS 1000000000ULL	// clear of the 0 that means "never"
+#define SIM_STEP_NS  100000000ULL	// model and tach step
+
+static pthread_mutex_t simLock = PTHREAD_MUTEX_INITIALIZER;
+static Smoker smoker;
+static int pwmPin = -1;
+static int pwmRange = 1;
+static int pwmValue;
+static double edgePhase;		// fraction of the next tach pulse already turned
+
+static atomic_ullong now = SIM_START_NS;
+static time_t wallStart;
+static void (*edgeHandler)(uint64_t ns);
+
+int HalSetup(const SmokerConfig* sim) {
+	pthread_mutex_lock(&simLock);
+	SmokerSetup(&smoker, sim);
+	pwmPin = -1;
+	pwmValue = 0;
+	edgePhase = 0.0;
+	pthread_mutex_unlock(&simLock);
+
+	atomic_store(&now, SIM_START_NS);
+	wallStart = time(NULL);
+
+	Log(LOG_LEVEL_INFO, "sim : smoker at %.0fx real time, seed %u", sim->speed, sim->seed);
+	return 0;
+}
+
+bool HalBoardPi4(void) {
+	return false;
+}
+
+int HalSpiSetup(int channel, int speed) {
+	return (channel == 0 || channel == 1) ? 0 : -1;
+}
+
+int HalSpiTransfer(int channel, unsigned char* data, int len) {
+	if (len != 2) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&simLock);
+	double temp = SmokerProbe(&smoker, channel);
+	pthread_mutex_unlock(&simLock);
+
+	// D14-D3 in quarter degrees, D2 for an open thermocouple
+	unsigned short word = 0x0004;
+	if (!isnan(temp)) {
+		word = (unsigned short)lround(fmin(fmax(temp, 0.0), 1023.75) * 4.0) << 3;
+	}
+	data[0] = word >> 8;
+	data[1] = word & 0xFF;
+	return 2;
+}
+
+int HalPwmSetup(int pin, int clock, int range) {
+	pthread_mutex_lock(&simLock);
+	if (pwmPin < 0 || pwmPin == pin) {
+		pwmPin = pin;
+		pwmRange = (range > 0) ? range : 1;
+		pwmValue = 0;
+	}
+	pthread_mutex_unlock(&simLock);
+	return 0;
+}
+
+int HalSoftPwmSetup(int pin, int range) {
+	return HalPwmSetup(pin, 0, range);
+}
+
+void HalPwmWrite(int pin, int value) {
+	pthread_mutex_lock(&simLock);
+	if (pin == pwmPin) {
+		pwmValue = value;
+	}
+	pthread_mutex_unlock(&simLock);
+}
+
+void HalPinRelease(int pin) {
+}
+
+int HalEdgeIsr(int pin, void (*edge)(uint64_t ns)) {
+	edgeHandler = edge;
+	return 0;
+}
+
+uint64_t HalNow(void) {
+	return atomic_load(&now);
+}
+
+// Steps the model from..to and emits the tach edges that fall in between
+static void advance(uint64_t from, uint64_t to) {
+	while (from < to) {
+		uint64_t end = (to - from > SIM_STEP_NS) ? from + SIM_STEP_NS : to;
+		double dt = (end - from) / 1e9;
+
+		pthread_mutex_lock(&simLock);
+		SmokerStep(&smoker, 100.0 * pwmValue / pwmRange, dt);
+		double rate = SmokerRpm(&smoker) / 60.0 * smoker.config.pulsesPerRev;
+		double phase = edgePhase + rate * dt;
+		edgePhase = phase - floor(phase);
+		pthread_mutex_unlock(&simLock);
+
+		// Edges at even spacing, the last one edgePhase pulses before end
+		for (int n = (int)phase; n > 0 && edgeHandler && rate > 0.0; n--) {
+			double before = (edgePhase + n - 1) / rate;
+			edgeHandler(end - (uint64_t)(before * 1e9));
+		}
+
+		atomic_store(&now, end);
+		from = end;
+	}
+}
+
+void HalSleepUntil(uint64_t ns) {
+	uint64_t from = atomic_load(&now);
+
+	if (ns <= from) {
+		return;
+	}
+
+	double speed = smoker.config.speed;
+	if (speed > 0.0) {
+		uint64_t real = (ns - from) / speed;
+		struct timespec ts = { real / 1000000000ULL, real % 1000000000ULL };
+		while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+		}
+	}
+	advance(from, ns);
+}
+
+time_t HalTime(void) {
+	return wallStart + (time_t)((atomic_load(&now) - SIM_START_NS) / 1000000000ULL);
+}
+
+void HalSimRead(Smoker* out) {
+	pthread_mutex_lock(&simLock);
+	*out = smoker;
+	pthread_mutex_unlock(&simLock);
+}
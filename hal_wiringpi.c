@@ -0,0 +1,133 @@
+#include <errno.h>
+#include <string.h>
+
+#include <softPwm.h>
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+
+#include "hal.h"
+
+
+// The Pi through wiringPi
+
+#define HAL_MAX_PINS 64
+
+// Board types from the revision code.  wiringPi 2.52, the one Raspberry Pi
+// OS ships, names only the 4B, later releases the rest.
+#ifndef PI_MODEL_4B
+#define PI_MODEL_4B  17
+#endif
+#ifndef PI_MODEL_400
+#define PI_MODEL_400 19
+#endif
+#ifndef PI_MODEL_CM4
+#define PI_MODEL_CM4 20
+#endif
+
+static void (*edgeHandler)(uint64_t ns);
+static int channelPin[2] = { -1, -1 };	// pin driving each hardware PWM channel
+static bool softPin[HAL_MAX_PINS];
+
+// Hardware PWM channel of a wiringPi pin: GPIO18 and GPIO12 are PWM0,
+// GPIO19 and GPIO13 PWM1.  -1 for any other pin.
+static int pwm_channel(int pin) {
+	switch (pin) {
+		case 1: case 26:	return 0;
+		case 24: case 23:	return 1;
+		default:		return -1;
+	}
+}
+
+int HalSetup(const SmokerConfig* sim) {
+	return wiringPiSetup();
+}
+
+bool HalBoardPi4(void) {
+	int board, rev, mem, maker, overVolted;
+
+	piBoardId(&board, &rev, &mem, &maker, &overVolted);
+	return board == PI_MODEL_4B || board == PI_MODEL_400 || board == PI_MODEL_CM4;
+}
+
+int HalSpiSetup(int channel, int speed) {
+	return wiringPiSPISetup(channel, speed);
+}
+
+int HalSpiTransfer(int channel, unsigned char* data, int len) {
+	return wiringPiSPIDataRW(channel, data, len);
+}
+
+int HalPwmSetup(int pin, int clock, int range) {
+	int channel = pwm_channel(pin);
+
+	if (channel < 0 || (channelPin[channel] >= 0 && channelPin[channel] != pin)) {
+		return -1;
+	}
+	channelPin[channel] = pin;
+
+	pinMode(pin, PWM_OUTPUT);
+	pullUpDnControl(pin, PUD_OFF);
+	pwmSetMode(PWM_MODE_MS);
+	pwmSetRange(range);
+	pwmSetClock(clock);
+	pwmWrite(pin, 0);
+	return 0;
+}
+
+int HalSoftPwmSetup(int pin, int range) {
+	if (pin < 0 || pin >= HAL_MAX_PINS || softPwmCreate(pin, 0, range) != 0) {
+		return -1;
+	}
+	softPin[pin] = true;
+	return 0;
+}
+
+void HalPwmWrite(int pin, int value) {
+	if (pin >= 0 && pin < HAL_MAX_PINS && softPin[pin]) {
+		softPwmWrite(pin, value);
+	}
+	else {
+		pwmWrite(pin, value);
+	}
+}
+
+void HalPinRelease(int pin) {
+	if (pin >= 0 && pin < HAL_MAX_PINS && softPin[pin]) {
+		softPwmStop(pin);
+		softPin[pin] = false;
+	}
+	pinMode(pin, INPUT);
+	pullUpDnControl(pin, PUD_DOWN);
+}
+
+static void edge_isr(void) {
+	edgeHandler(HalNow());
+}
+
+int HalEdgeIsr(int pin, void (*edge)(uint64_t ns)) {
+	edgeHandler = edge;
+	HalPinRelease(pin);
+	return wiringPiISR(pin, INT_EDGE_RISING, &edge_isr);
+}
+
+uint64_t HalNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void HalSleepUntil(uint64_t ns) {
+	struct timespec deadline = { ns / 1000000000ULL, ns % 1000000000ULL };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+	}
+}
+
+time_t HalTime(void) {
+	return time(NULL);
+}
+
+void HalSimRead(Smoker* smoker) {
+	memset(smoker, 0, sizeof(*smoker));
+}
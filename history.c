@@ -0,0 +1,287 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "history.h"
+
+
+#define HISTORY_PAGE 600	// samples per HistoryRender call
+
+typedef struct HistoryTierRing {
+	int		resolution;	// seconds per sample
+	uint32_t	capacity;
+	HistorySample*	ring;
+	uint32_t	count;		// samples ever committed, also the next cursor
+
+	// Bucket being filled
+	bool		open;
+	HistorySample	acc;
+	uint32_t	n;
+	uint32_t	probeN[STATE_MAX_PROBES];
+} HistoryTierRing;
+
+// 2 hours at 1 s, 24 hours at 10 s, 48 hours at 1 minute
+static HistorySample ring1s[7200];
+static HistorySample ring10s[8640];
+static HistorySample ring1m[2880];
+
+static HistoryTierRing tiers[HISTORY_TIERS] = {
+	{ 1,  sizeof(ring1s) / sizeof(HistorySample),  ring1s },
+	{ 10, sizeof(ring10s) / sizeof(HistorySample), ring10s },
+	{ 60, sizeof(ring1m) / sizeof(HistorySample),  ring1m },
+};
+
+static pthread_mutex_t historyLock = PTHREAD_MUTEX_INITIALIZER;
+static int probes = 0;
+
+void HistorySetup(int probeCount) {
+	pthread_mutex_lock(&historyLock);
+	probes = (probeCount > STATE_MAX_PROBES) ? STATE_MAX_PROBES : probeCount;
+	for (int t = 0; t < HISTORY_TIERS; t++) {
+		tiers[t].count = 0;
+		tiers[t].open = false;
+	}
+	pthread_mutex_unlock(&historyLock);
+}
+
+static void bucket_open(HistoryTierRing* tier, uint32_t time) {
+	tier->open = true;
+	tier->n = 0;
+	tier->acc.time = time - time % tier->resolution;
+	tier->acc.target = tier->acc.duty = tier->acc.rpm = 0.0f;
+	for (int i = 0; i < probes; i++) {
+		tier->probeN[i] = 0;
+		tier->acc.tempMin[i] = tier->acc.tempMax[i] = NAN;
+		tier->acc.tempAvg[i] = 0.0f;
+	}
+}
+
+// Adds a sample, min / max / avg of a finer bucket or a single reading
+static void bucket_add(HistoryTierRing* tier, const HistorySample* s) {
+	HistorySample* acc = &tier->acc;
+
+	for (int i = 0; i < probes; i++) {
+		if (isnan(s->tempAvg[i])) {
+			continue;
+		}
+		if (tier->probeN[i] == 0 || s->tempMin[i] < acc->tempMin[i]) acc->tempMin[i] = s->tempMin[i];
+		if (tier->probeN[i] == 0 || s->tempMax[i] > acc->tempMax[i]) acc->tempMax[i] = s->tempMax[i];
+		acc->tempAvg[i] += s->tempAvg[i];
+		tier->probeN[i]++;
+	}
+
+	acc->target += s->target;
+	acc->duty += s->duty;
+	acc->rpm += s->rpm;
+	tier->n++;
+}
+
+static void bucket_close(HistoryTierRing* tier, HistorySample* out) {
+	*out = tier->acc;
+
+	for (int i = 0; i < probes; i++) {
+		out->tempAvg[i] = tier->probeN[i] ? out->tempAvg[i] / tier->probeN[i] : NAN;
+	}
+	if (tier->n) {
+		out->target /= tier->n;
+		out->duty /= tier->n;
+		out->rpm /= tier->n;
+	}
+
+	tier->ring[tier->count % tier->capacity] = *out;
+	tier->count++;
+	tier->open = false;
+}
+
+// Feeds tier t, closing its bucket and cascading into the next tier when
+// the sample belongs to a new bucket
+static void tier_add(int t, const HistorySample* s) {
+	HistoryTierRing* tier = &tiers[t];
+
+	if (tier->open && s->time - s->time % tier->resolution != tier->acc.time) {
+		HistorySample done;
+		bucket_close(tier, &done);
+		if (t + 1 < HISTORY_TIERS) {
+			tier_add(t + 1, &done);
+		}
+	}
+
+	if (!tier->open) {
+		bucket_open(tier, s->time);
+	}
+	bucket_add(tier, s);
+}
+
+void HistoryRecord(uint32_t now, const float temps[], float target, float duty, float rpm) {
+	HistorySample s = { .time = now, .target = target, .duty = duty, .rpm = rpm };
+
+	for (int i = 0; i < probes; i++) {
+		s.tempMin[i] = s.tempMax[i] = s.tempAvg[i] = temps[i];
+	}
+
+	pthread_mutex_lock(&historyLock);
+	tier_add(0, &s);
+	pthread_mutex_unlock(&historyLock);
+}
+
+void HistoryRestore(const HistorySample* samples, long count) {
+	pthread_mutex_lock(&historyLock);
+	for (long i = 0; i < count; i++) {
+		tier_add(0, &samples[i]);
+	}
+
+	for (int t = 0; t < HISTORY_TIERS; t++) {
+		if (tiers[t].open) {
+			HistorySample done;
+			bucket_close(&tiers[t], &done);
+			if (t + 1 < HISTORY_TIERS) {
+				tier_add(t + 1, &done);
+			}
+		}
+	}
+	pthread_mutex_unlock(&historyLock);
+}
+
+long HistoryRestoreCapacity(void) {
+	const HistoryTierRing* last = &tiers[HISTORY_TIERS - 1];
+	return (long)last->capacity * last->resolution;
+}
+
+uint32_t HistoryCursor(int tier) {
+	uint32_t count;
+
+	pthread_mutex_lock(&historyLock);
+	count = (tier >= 0 && tier < HISTORY_TIERS) ? tiers[tier].count : 0;
+	pthread_mutex_unlock(&historyLock);
+
+	return count;
+}
+
+int HistoryProbes(void) {
+	return probes;
+}
+
+int HistoryTier(int resolution) {
+	for (int t = 0; t < HISTORY_TIERS; t++) {
+		if (tiers[t].resolution == resolution) {
+			return t;
+		}
+	}
+	return -1;
+}
+
+int HistoryResolution(int tier) {
+	return (tier >= 0 && tier < HISTORY_TIERS) ? tiers[tier].resolution : 0;
+}
+
+int HistoryRead(int t, uint32_t since, HistorySample* out, int max, uint32_t* next) {
+	int n = 0;
+
+	if (t < 0 || t >= HISTORY_TIERS) {
+		*next = since;
+		return 0;
+	}
+
+	pthread_mutex_lock(&historyLock);
+	HistoryTierRing* tier = &tiers[t];
+	uint32_t oldest = (tier->count > tier->capacity) ? tier->count - tier->capacity : 0;
+
+	if (since < oldest || since > tier->count) {
+		since = oldest;
+	}
+	for (; since < tier->count && n < max; since++, n++) {
+		out[n] = tier->ring[since % tier->capacity];
+	}
+	pthread_mutex_unlock(&historyLock);
+
+	*next = since;
+	return n;
+}
+
+typedef struct Buffer {
+	char*	data;
+	size_t	len;
+	size_t	size;
+	bool	failed;
+} Buffer;
+
+static void put(Buffer* b, const char* fmt, ...) {
+	va_list args;
+
+	while (!b->failed) {
+		va_start(args, fmt);
+		int n = vsnprintf(b->data + b->len, b->size - b->len, fmt, args);
+		va_end(args);
+
+		if (n < 0) {
+			b->failed = true;
+		} else if ((size_t)n < b->size - b->len) {
+			b->len += n;
+			return;
+		} else {
+			char* grown = realloc(b->data, b->size * 2 + n);
+			if (grown) {
+				b->data = grown;
+				b->size = b->size * 2 + n;
+			} else {
+				b->failed = true;
+			}
+		}
+	}
+}
+
+static void put_temps(Buffer* b, const float* temps) {
+	put(b, "[");
+	for (int i = 0; i < probes; i++) {
+		if (isnan(temps[i])) {
+			put(b, "%snull", i ? "," : "");
+		} else {
+			put(b, "%s%.2f", i ? "," : "", temps[i]);
+		}
+	}
+	put(b, "]");
+}
+
+char* HistoryRender(int tier, uint32_t since, size_t* len) {
+	HistorySample* page = malloc(sizeof(HistorySample) * HISTORY_PAGE);
+	if (page == NULL) {
+		return NULL;
+	}
+
+	uint32_t next;
+	int n = HistoryRead(tier, since, page, HISTORY_PAGE, &next);
+
+	Buffer b = { malloc(4096), 0, 4096, false };
+	if (b.data == NULL) {
+		free(page);
+		return NULL;
+	}
+
+	uint32_t first = next - n;
+	put(&b, "{\"resolution\": %d,\"first\": %u,\"cursor\": %u,\"more\": %s,"
+		"\"fields\": [\"time\",\"target\",\"duty\",\"rpm\",\"min\",\"max\",\"avg\"],\"samples\": [",
+		HistoryResolution(tier), first, next, (n == HISTORY_PAGE) ? "true" : "false");
+
+	for (int i = 0; i < n; i++) {
+		put(&b, "%s[%u,%.2f,%.1f,%.0f,", i ? "," : "", page[i].time, page[i].target, page[i].duty, page[i].rpm);
+		put_temps(&b, page[i].tempMin);
+		put(&b, ",");
+		put_temps(&b, page[i].tempMax);
+		put(&b, ",");
+		put_temps(&b, page[i].tempAvg);
+		put(&b, "]");
+	}
+	put(&b, "]}");
+	free(page);
+
+	if (b.failed) {
+		free(b.data);
+		return NULL;
+	}
+
+	*len = b.len;
+	return b.data;
+}
@@ -0,0 +1,60 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "state.h"
+
+// In memory time series of the cook.
+//
+// heartThread records every cycle; samples are folded into fixed size
+// rings at 1 s, 10 s and 1 min resolution, each slot holding the min, max
+// and average of the probes over its bucket.  All memory is static.
+// Readers page through a tier with a cursor: the sequence number of the
+// next sample they have not seen yet.
+
+#define HISTORY_TIERS 3
+
+typedef struct HistorySample {
+	uint32_t	time;		// unix time at the start of the bucket
+	float		tempMin[STATE_MAX_PROBES];	// NAN when the probe had no good reading
+	float		tempMax[STATE_MAX_PROBES];
+	float		tempAvg[STATE_MAX_PROBES];
+	float		target;
+	float		duty;
+	float		rpm;
+} HistorySample;
+
+
+void HistorySetup(int probeCount);
+
+// Adds one control cycle, temps may contain NAN for bad probes
+void HistoryRecord(uint32_t now, const float temps[], float target, float duty, float rpm);
+
+// Refills the rings from 1 s samples, oldest first, as read back from the
+// cook log.  Every bucket is closed so the restored samples are not handed
+// out again under new cursors.
+void HistoryRestore(const HistorySample* samples, long count);
+
+// Number of 1 s samples the coarsest tier spans, the most worth restoring
+long HistoryRestoreCapacity(void);
+
+// Cursor of the next sample tier will commit
+uint32_t HistoryCursor(int tier);
+int HistoryProbes(void);
+
+// Tier index for a resolution in seconds, -1 if there is none
+int HistoryTier(int resolution);
+int HistoryResolution(int tier);
+
+// Copies up to max samples with a sequence number >= since into out.
+// since is moved up to the oldest sample still held.  *next receives the
+// cursor to pass on the following call.  Returns the number copied.
+int HistoryRead(int tier, uint32_t since, HistorySample* out, int max, uint32_t* next);
+
+// Renders the samples from cursor since as JSON, caller frees.  NULL on
+// allocation failure.
+char* HistoryRender(int tier, uint32_t since, size_t* len);
+
+#endif
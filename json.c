@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+
+
+typedef struct Parser {
+	const char*	p;
+	const char*	end;
+	JsonField	field;
+	void*		arg;
+	const char*	error;
+	int		depth;
+} Parser;
+
+static bool fail(Parser* parser, const char* error) {
+	if (parser->error == NULL) {
+		parser->error = error;
+	}
+	return false;
+}
+
+static void skip_space(Parser* parser) {
+	while (parser->p < parser->end && (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' || *parser->p == '\r')) {
+		parser->p++;
+	}
+}
+
+static bool literal(Parser* parser, const char* word) {
+	size_t n = strlen(word);
+
+	if ((size_t)(parser->end - parser->p) < n || memcmp(parser->p, word, n)) {
+		return false;
+	}
+	parser->p += n;
+	return true;
+}
+
+static int hex(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// Unescapes a string into out, non ASCII \u escapes become '?'
+static bool parse_string(Parser* parser, char* out, size_t size) {
+	size_t len = 0;
+
+	if (parser->p >= parser->end || *parser->p != '"') {
+		return fail(parser, "expected a string");
+	}
+	parser->p++;
+
+	while (parser->p < parser->end && *parser->p != '"') {
+		char c = *parser->p++;
+
+		if (c == '\\') {
+			if (parser->p >= parser->end) break;
+			c = *parser->p++;
+			switch (c) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case 'r': c = '\r'; break;
+				case 'b': c = '\b'; break;
+				case 'f': c = '\f'; break;
+				case 'u': {
+					int code = 0;
+					for (int i = 0; i < 4; i++) {
+						int h = (parser->p < parser->end) ? hex(*parser->p++) : -1;
+						if (h < 0) return fail(parser, "bad unicode escape");
+						code = code * 16 + h;
+					}
+					c = (code < 0x80) ? code : '?';
+					break;
+				}
+				case '"': case '\\': case '/': break;
+				default: return fail(parser, "bad escape");
+			}
+		} else if ((unsigned char)c < 0x20) {
+			return fail(parser, "control character in string");
+		}
+
+		if (len + 1 >= size) {
+			return fail(parser, "string too long");
+		}
+		out[len++] = c;
+	}
+
+	if (parser->p >= parser->end) {
+		return fail(parser, "unterminated string");
+	}
+	parser->p++;
+	out[len] = '\0';
+	return true;
+}
+
+static bool parse_object(Parser* parser, const char* prefix);
+
+static bool parse_member(Parser* parser, const char* key) {
+	JsonValue value = { JSON_NULL };
+	char text[JSON_STRING_MAX];
+
+	skip_space(parser);
+	if (parser->p >= parser->end) {
+		return fail(parser, "unexpected end of input");
+	}
+
+	char c = *parser->p;
+	if (c == '{') {
+		return parse_object(parser, key);
+	} else if (c == '[') {
+		return fail(parser, "arrays are not supported");
+	} else if (c == '"') {
+		if (!parse_string(parser, text, sizeof(text))) return false;
+		value.type = JSON_STRING;
+		value.string = text;
+	} else if (literal(parser, "true") || literal(parser, "false")) {
+		value.type = JSON_BOOL;
+		value.boolean = (c == 't');
+	} else if (literal(parser, "null")) {
+		value.type = JSON_NULL;
+	} else {
+		// strtod wants a terminated string, numbers are short
+		char number[48];
+		size_t n = 0;
+		while (parser->p + n < parser->end && n < sizeof(number) - 1 && strchr("+-0123456789.eE", parser->p[n])) {
+			number[n] = parser->p[n];
+			n++;
+		}
+		number[n] = '\0';
+
+		char* end;
+		value.number = strtod(number, &end);
+		if (n == 0 || end != number + n) {
+			return fail(parser, "bad value");
+		}
+		value.type = JSON_NUMBER;
+		parser->p += n;
+	}
+
+	return parser->field(parser->arg, key, &value) || fail(parser, "rejected member");
+}
+
+static bool parse_object(Parser* parser, const char* prefix) {
+	if (++parser->depth > JSON_DEPTH_MAX) {
+		return fail(parser, "nested too deep");
+	}
+
+	skip_space(parser);
+	if (parser->p >= parser->end || *parser->p != '{') {
+		return fail(parser, "expected an object");
+	}
+	parser->p++;
+
+	skip_space(parser);
+	if (parser->p < parser->end && *parser->p == '}') {
+		parser->p++;
+		parser->depth--;
+		return true;
+	}
+
+	for (;;) {
+		char name[JSON_KEY_MAX];
+		char key[JSON_KEY_MAX * JSON_DEPTH_MAX];
+
+		skip_space(parser);
+		if (!parse_string(parser, name, sizeof(name))) return false;
+		if (prefix[0]) {
+			snprintf(key, sizeof(key), "%s.%s", prefix, name);
+		} else {
+			snprintf(key, sizeof(key), "%s", name);
+		}
+
+		skip_space(parser);
+		if (parser->p >= parser->end || *parser->p++ != ':') {
+			return fail(parser, "expected ':'");
+		}
+		if (!parse_member(parser, key)) return false;
+
+		skip_space(parser);
+		if (parser->p < parser->end && *parser->p == ',') {
+			parser->p++;
+			continue;
+		}
+		if (parser->p < parser->end && *parser->p == '}') {
+			parser->p++;
+			parser->depth--;
+			return true;
+		}
+		return fail(parser, "expected ',' or '}'");
+	}
+}
+
+int JsonParse(const char* text, size_t len, JsonField field, void* arg, const char** error) {
+	Parser parser = { text, text + len, field, arg, NULL, 0 };
+
+	bool ok = parse_object(&parser, "");
+	if (ok) {
+		skip_space(&parser);
+		if (parser.p != parser.end) {
+			ok = fail(&parser, "trailing characters");
+		}
+	}
+
+	if (!ok && error) {
+		*error = parser.error;
+	}
+	return ok ? 0 : -1;
+}
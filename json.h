@@ -0,0 +1,38 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Minimal JSON object reader for request bodies.
+//
+// Walks an object and hands every scalar member to a callback, members
+// of nested objects under a dotted key ("gains.kp").  Arrays are not
+// supported.  Nothing is allocated, strings are unescaped into a buffer
+// on the stack.
+
+#define JSON_KEY_MAX    64
+#define JSON_STRING_MAX 128
+#define JSON_DEPTH_MAX  4
+
+typedef enum {
+	JSON_NULL,
+	JSON_BOOL,
+	JSON_NUMBER,
+	JSON_STRING,
+} JsonType;
+
+typedef struct JsonValue {
+	JsonType	type;
+	bool		boolean;
+	double		number;
+	const char*	string;
+} JsonValue;
+
+// Return false to stop the walk, JsonParse then fails
+typedef bool (*JsonField)(void* arg, const char* key, const JsonValue* value);
+
+// Returns 0, or -1 with *error set to a static description
+int JsonParse(const char* text, size_t len, JsonField field, void* arg, const char** error);
+
+#endif
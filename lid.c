@@ -0,0 +1,77 @@
+#include <math.h>
+#include <string.h>
+
+#include "lid.h"
+
+
+void LidSetup(Lid* lid, const LidConfig* config) {
+	memset(lid, 0, sizeof(*lid));
+	lid->config = *config;
+}
+
+void LidConfigure(Lid* lid, const LidConfig* config) {
+	lid->config = *config;
+}
+
+void LidReset(Lid* lid) {
+	lid->head = lid->fill = 0;
+	lid->slope = 0.0;
+	lid->open = false;
+}
+
+// Least squares slope over the window, and the oldest sample at its peak
+static const LidSample* fit(Lid* lid, double now) {
+	const LidSample* peak = NULL;
+	double n = 0.0, st = 0.0, sT = 0.0, stt = 0.0, stT = 0.0;
+
+	for (int k = 0; k < lid->fill; k++) {
+		const LidSample* s = &lid->ring[(lid->head + LID_RING_SIZE - 1 - k) % LID_RING_SIZE];
+		double t = s->t - now;
+		if (t < -lid->config.windowS) {
+			break;
+		}
+
+		n++;
+		st += t;
+		sT += s->temp;
+		stt += t * t;
+		stT += t * s->temp;
+
+		if (peak == NULL || s->temp >= peak->temp) {
+			peak = s;
+		}
+	}
+
+	double det = n * stt - st * st;
+	lid->slope = (n >= 3 && det > 0.0) ? (n * stT - st * sT) / det : 0.0;
+	return peak;
+}
+
+bool LidUpdate(Lid* lid, double t, double measurement, double duty) {
+	const LidConfig* config = &lid->config;
+
+	lid->ring[lid->head] = (LidSample){ t, measurement, duty };
+	lid->head = (lid->head + 1) % LID_RING_SIZE;
+	if (lid->fill < LID_RING_SIZE) {
+		lid->fill++;
+	}
+
+	const LidSample* peak = fit(lid, t);
+
+	if (lid->open) {
+		if (measurement >= lid->peak - config->recovery || t - lid->openedAt >= config->timeoutS) {
+			lid->open = false;
+		}
+		return lid->open;
+	}
+
+	if (config->dropRate > 0.0 && peak && lid->slope <= -config->dropRate
+		&& peak->temp - measurement >= config->minDrop) {
+		lid->open = true;
+		lid->openedAt = t;
+		lid->peak = peak->temp;
+		lid->hold = peak->duty;
+		lid->events++;
+	}
+	return lid->open;
+}
@@ -0,0 +1,56 @@
+#ifndef LID_H
+#define LID_H
+
+#include <stdbool.h>
+
+// Lid open detection.
+//
+// Opening the lid dumps the hot air and the pit temperature falls far
+// faster than any fire does.  A controller sees a big error and runs the
+// fan flat out, stoking the coals so the pit overshoots once the lid is
+// shut again.  While the drop lasts the fan is held at the duty it had
+// before the drop, until the pit has recovered or the hold times out.
+
+#define LID_RING_SIZE 128	// samples the slope can be fitted over
+
+typedef struct LidConfig {
+	double	dropRate;	// degrees per second the pit must fall at, 0 disables
+	double	minDrop;	// degrees below the recent peak before a drop counts
+	int	windowS;	// seconds the slope and the peak are taken over
+	double	recovery;	// degrees below the pre drop peak that count as recovered
+	int	timeoutS;	// longest hold
+} LidConfig;
+
+typedef struct LidSample {
+	double	t;
+	float	temp;
+	float	duty;
+} LidSample;
+
+typedef struct Lid {
+	LidConfig	config;
+	LidSample	ring[LID_RING_SIZE];
+	int		head;
+	int		fill;
+
+	double		slope;		// degrees per second over the window
+	bool		open;
+	double		openedAt;
+	double		peak;		// pit temperature before the drop
+	double		hold;		// duty held while open
+	unsigned long	events;
+} Lid;
+
+
+void LidSetup(Lid* lid, const LidConfig* config);
+void LidConfigure(Lid* lid, const LidConfig* config);
+
+// Forgets the history, after the fan was off or the probe faulted
+void LidReset(Lid* lid);
+
+// Feeds the filtered pit temperature at time t (seconds) together with the
+// duty that was on the fan.  Returns true while the lid is taken to be open,
+// the fan should then run at lid->hold.
+bool LidUpdate(Lid* lid, double t, double measurement, double duty);
+
+#endif
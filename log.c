@@ -0,0 +1,166 @@
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "log.h"
+
+
+// Bounded multi producer ring, each slot carries the position it is
+// ready for: pos while free for the producer of pos, pos + 1 once filled
+typedef struct LogSlot {
+	atomic_uint	seq;
+	char		text[LOG_LINE_MAX];
+} LogSlot;
+
+static LogSlot ring[LOG_RING_SIZE];
+static atomic_uint head;	// next position to claim
+static unsigned int tail;	// next position to write out, writer thread only
+static pthread_once_t ringOnce = PTHREAD_ONCE_INIT;
+
+static atomic_int level = LOG_LEVEL_INFO;
+static atomic_int rate = 0;
+static atomic_long window;	// second the count below is for
+static atomic_int windowCount;
+
+static atomic_ullong dropped;
+static atomic_ullong limited;
+
+static sem_t pending;
+static pthread_t writerTid;
+static atomic_bool running;
+static atomic_bool stopping;
+
+static void init_ring(void) {
+	for (unsigned int i = 0; i < LOG_RING_SIZE; i++) {
+		atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+	}
+}
+
+// Drains everything that is complete, stops at a slot still being filled
+static void drain(void) {
+	for (;;) {
+		LogSlot* slot = &ring[tail & (LOG_RING_SIZE - 1)];
+		if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+			break;
+		}
+		fputs(slot->text, stdout);
+		atomic_store_explicit(&slot->seq, tail + LOG_RING_SIZE, memory_order_release);
+		tail++;
+	}
+	fflush(stdout);
+}
+
+static void* writer_thread(void* arg) {
+	while (!atomic_load(&stopping)) {
+		while (sem_wait(&pending) != 0);
+		drain();
+	}
+	drain();
+	return arg;
+}
+
+int LogSetup(LogLevel logLevel, int ratePerSecond) {
+	pthread_once(&ringOnce, init_ring);
+
+	LogConfigure(logLevel, ratePerSecond);
+
+	if (sem_init(&pending, 0, 0) != 0 || pthread_create(&writerTid, NULL, writer_thread, NULL) != 0) {
+		return -1;
+	}
+	atomic_store(&running, true);
+	sem_post(&pending);	// write out anything logged before now
+	return 0;
+}
+
+void LogClose(void) {
+	if (atomic_exchange(&running, false)) {
+		atomic_store(&stopping, true);
+		sem_post(&pending);
+		pthread_join(writerTid, NULL);
+	}
+}
+
+void LogConfigure(LogLevel logLevel, int ratePerSecond) {
+	atomic_store(&level, logLevel);
+	atomic_store(&rate, ratePerSecond);
+}
+
+bool LogEnabled(LogLevel logLevel) {
+	return logLevel <= atomic_load_explicit(&level, memory_order_relaxed);
+}
+
+static bool rate_ok(void) {
+	int limit = atomic_load_explicit(&rate, memory_order_relaxed);
+	if (limit <= 0) {
+		return true;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+	long current = atomic_load_explicit(&window, memory_order_relaxed);
+	if (ts.tv_sec != current && atomic_compare_exchange_strong(&window, &current, ts.tv_sec)) {
+		atomic_store_explicit(&windowCount, 0, memory_order_relaxed);
+	}
+	return atomic_fetch_add_explicit(&windowCount, 1, memory_order_relaxed) < limit;
+}
+
+void Log(LogLevel logLevel, const char* fmt, ...) {
+	if (!LogEnabled(logLevel)) {
+		return;
+	}
+	pthread_once(&ringOnce, init_ring);
+
+	if (logLevel != LOG_LEVEL_ERROR && !rate_ok()) {
+		atomic_fetch_add_explicit(&limited, 1, memory_order_relaxed);
+		return;
+	}
+
+	// Claim a slot, give up rather than wait if the writer is a lap behind
+	unsigned int pos = atomic_load_explicit(&head, memory_order_relaxed);
+	LogSlot* slot;
+	for (;;) {
+		slot = &ring[pos & (LOG_RING_SIZE - 1)];
+		int diff = (int)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+			return;
+		} else {
+			pos = atomic_load_explicit(&head, memory_order_relaxed);
+		}
+	}
+
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(slot->text, sizeof(slot->text) - 1, fmt, args);
+	va_end(args);
+
+	// Every record is one line, a long one is cut
+	if (n < 0) n = 0;
+	if (n > (int)sizeof(slot->text) - 2) n = sizeof(slot->text) - 2;
+	if (n == 0 || slot->text[n - 1] != '\n') {
+		slot->text[n++] = '\n';
+		slot->text[n] = '\0';
+	}
+
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+	if (atomic_load_explicit(&running, memory_order_relaxed)) {
+		sem_post(&pending);
+	}
+}
+
+unsigned long long LogDropped(void) {
+	return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+unsigned long long LogLimited(void) {
+	return atomic_load_explicit(&limited, memory_order_relaxed);
+}
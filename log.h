@@ -0,0 +1,42 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdbool.h>
+
+// Asynchronous log.
+//
+// Callers format into a slot of a bounded lock-free ring and return, a
+// background thread writes the lines out.  A full ring, or more lines in
+// a second than the rate limit, drops the line and counts it instead of
+// blocking, so logging from the control loop never waits on stdout or
+// the journal behind it.
+
+#define LOG_RING_SIZE 256	// power of two
+#define LOG_LINE_MAX  160
+
+typedef enum {
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG,
+} LogLevel;
+
+
+// Starts the writer thread.  Lines logged before that are queued.
+int LogSetup(LogLevel level, int ratePerSecond);
+
+// Writes out what is queued and stops the writer thread
+void LogClose(void);
+
+void LogConfigure(LogLevel level, int ratePerSecond);
+
+bool LogEnabled(LogLevel level);
+
+// Errors are never rate limited
+void Log(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Lines lost to a full ring and to the rate limit
+unsigned long long LogDropped(void);
+unsigned long long LogLimited(void);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "MAX6675.h"
+#include "metrics.h"
+#include "status.h"
+
+
+#define METRICS_BUFFERS     4
+#define METRICS_BUFFER_SIZE 32768
+
+Metrics metrics;
+
+// Upper bounds in nanoseconds, 50us to 1s
+static const uint64_t bounds[METRIC_BUCKETS] = {
+	50000, 100000, 250000, 500000,
+	1000000, 2500000, 5000000, 10000000,
+	25000000, 50000000, 100000000, 250000000,
+	1000000000
+};
+
+static const char* pathNames[METRIC_PATHS] = {
+	[METRIC_PATH_STATUS]			= "/status",
+	[METRIC_PATH_EVENTS]			= "/events",
+	[METRIC_PATH_HISTORY]			= "/history",
+	[METRIC_PATH_METRICS]			= "/metrics",
+	[METRIC_PATH_TARGET_TEMPERATURE]	= "/targetTemperature",
+	[METRIC_PATH_TARGET_STATE]		= "/targetHeatingCoolingState",
+	[METRIC_PATH_CURRENT_TEMPERATURE]	= "/currentTemperature",
+	[METRIC_PATH_CONTROLLER]		= "/controller",
+	[METRIC_PATH_CONTROLLER_GAINS]		= "/controllerGains",
+	[METRIC_PATH_AUTOTUNE]			= "/autotune",
+	[METRIC_PATH_V2_STATE]			= "/v2/state",
+	[METRIC_PATH_ZONES]			= "/zones",
+	[METRIC_PATH_OTHER]			= "other",
+};
+
+static char buffers[METRICS_BUFFERS][METRICS_BUFFER_SIZE];
+static atomic_bool inUse[METRICS_BUFFERS];
+
+uint64_t MetricNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void MetricObserve(MetricHistogram* histogram, uint64_t ns) {
+	int b = 0;
+
+	while (b < METRIC_BUCKETS && ns > bounds[b]) {
+		b++;
+	}
+
+	// Buckets hold plain counts, the cumulative sums are built at render time
+	atomic_fetch_add_explicit(&histogram->buckets[b], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&histogram->sumNs, ns, memory_order_relaxed);
+}
+
+MetricPath MetricPathFor(const char* url) {
+	if (!strcmp(url, "/currentTempreture")) {
+		return METRIC_PATH_CURRENT_TEMPERATURE;
+	}
+	if (!strncmp(url, "/zones/", 7)) {
+		return METRIC_PATH_ZONES;	// every zone's endpoints under one label
+	}
+	for (int p = 0; p < METRIC_PATH_OTHER; p++) {
+		if (!strcmp(url, pathNames[p])) {
+			return p;
+		}
+	}
+	return METRIC_PATH_OTHER;
+}
+
+static unsigned long long load(atomic_ullong* value) {
+	return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+static bool render_header(char* buf, size_t size, size_t* len, const char* name, const char* type, const char* help) {
+	return StatusAppend(buf, size, len, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static bool render_histogram(char* buf, size_t size, size_t* len, const char* name, const char* labels, MetricHistogram* h) {
+	unsigned long long cumulative = 0;
+	bool ok = true;
+	const char* sep = labels[0] ? "," : "";
+
+	for (int b = 0; ok && b <= METRIC_BUCKETS; b++) {
+		cumulative += load(&h->buckets[b]);
+		if (b < METRIC_BUCKETS) {
+			ok = StatusAppend(buf, size, len, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep, bounds[b] / 1e9, cumulative);
+		} else {
+			ok = StatusAppend(buf, size, len, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, cumulative);
+		}
+	}
+
+	return ok
+		&& StatusAppend(buf, size, len, "%s_sum{%s} %.9f\n", name, labels, load(&h->sumNs) / 1e9)
+		&& StatusAppend(buf, size, len, "%s_count{%s} %llu\n", name, labels, load(&h->count));
+}
+
+static bool render_counter(char* buf, size_t size, size_t* len, const char* name, const char* help, atomic_ullong* value) {
+	return render_header(buf, size, len, name, "counter", help)
+		&& StatusAppend(buf, size, len, "%s %llu\n", name, load(value));
+}
+
+static int render(char* buf, size_t size) {
+	size_t len = 0;
+	bool ok = true;
+
+	ok = ok && render_header(buf, size, &len, "bbq_spi_read_seconds", "histogram", "MAX6675 SPI transfer latency");
+	ok = ok && render_histogram(buf, size, &len, "bbq_spi_read_seconds", "", &metrics.spiRead);
+
+	ok = ok && render_header(buf, size, &len, "bbq_probe_reads_total", "counter", "Probe readings by outcome");
+	for (int p = 0; ok && p < STATE_MAX_PROBES; p++) {
+		for (int s = 0; ok && s < METRIC_PROBE_STATUSES; s++) {
+			ok = StatusAppend(buf, size, &len, "bbq_probe_reads_total{probe=\"%d\",status=\"%s\"} %llu\n",
+				p, MAX6675StatusStr(s), load(&metrics.probeReads[p][s]));
+		}
+	}
+
+	ok = ok && render_header(buf, size, &len, "bbq_control_loop_duration_seconds", "histogram", "Time spent in one control cycle");
+	ok = ok && render_histogram(buf, size, &len, "bbq_control_loop_duration_seconds", "", &metrics.loopDuration);
+	ok = ok && render_header(buf, size, &len, "bbq_control_loop_jitter_seconds", "histogram", "Control loop wake up latency");
+	ok = ok && render_histogram(buf, size, &len, "bbq_control_loop_jitter_seconds", "", &metrics.loopJitter);
+	ok = ok && render_counter(buf, size, &len, "bbq_control_loop_overruns_total", "Control cycles that missed their deadline", &metrics.loopOverruns);
+
+	ok = ok && render_counter(buf, size, &len, "bbq_pwm_writes_total", "Writes to the PWM register", &metrics.pwmWrites);
+	ok = ok && render_counter(buf, size, &len, "bbq_pwm_held_total", "Fan changes held back by the deadband", &metrics.pwmHeld);
+	ok = ok && render_counter(buf, size, &len, "bbq_lid_open_total", "Lid openings the fan was held through", &metrics.lidEvents);
+
+	ok = ok && render_counter(buf, size, &len, "bbq_tach_edges_total", "Accepted tachometer edges", &metrics.tachEdges);
+	ok = ok && render_counter(buf, size, &len, "bbq_tach_bounced_total", "Tachometer edges rejected as bounce", &metrics.tachBounced);
+	ok = ok && render_counter(buf, size, &len, "bbq_tach_dropped_total", "Tachometer edges lost to a full ring", &metrics.tachDropped);
+
+	ok = ok && render_counter(buf, size, &len, "bbq_log_dropped_total", "Log lines lost to a full ring", &metrics.logDropped);
+	ok = ok && render_counter(buf, size, &len, "bbq_log_limited_total", "Log lines over the rate limit", &metrics.logLimited);
+
+	ok = ok && render_header(buf, size, &len, "bbq_http_requests_total", "counter", "HTTP requests by path");
+	for (int p = 0; ok && p < METRIC_PATHS; p++) {
+		ok = StatusAppend(buf, size, &len, "bbq_http_requests_total{path=\"%s\"} %llu\n", pathNames[p], load(&metrics.httpRequests[p]));
+	}
+
+	ok = ok && render_header(buf, size, &len, "bbq_http_request_duration_seconds", "histogram", "Time to handle an HTTP request by path");
+	for (int p = 0; ok && p < METRIC_PATHS; p++) {
+		char labels[64];
+		snprintf(labels, sizeof(labels), "path=\"%s\"", pathNames[p]);
+		ok = render_histogram(buf, size, &len, "bbq_http_request_duration_seconds", labels, &metrics.httpLatency[p]);
+	}
+
+	return ok ? (int)len : -1;
+}
+
+static void release_buffer(void* cls) {
+	int slot = ((char*)cls - &buffers[0][0]) / METRICS_BUFFER_SIZE;
+	atomic_store(&inUse[slot], false);
+}
+
+int MetricsQueue(struct MHD_Connection* conn) {
+	int slot = -1;
+
+	for (int i = 0; i < METRICS_BUFFERS && slot < 0; i++) {
+		bool expected = false;
+		if (atomic_compare_exchange_strong(&inUse[i], &expected, true)) {
+			slot = i;
+		}
+	}
+
+	struct MHD_Response* res = NULL;
+	int len = (slot >= 0) ? render(buffers[slot], METRICS_BUFFER_SIZE) : -1;
+
+	if (len >= 0) {
+		res = MHD_create_response_from_buffer_with_free_callback(len, buffers[slot], &release_buffer);
+	}
+	if (res == NULL) {
+		if (slot >= 0) atomic_store(&inUse[slot], false);
+
+		return StatusQueueResponse(conn, MHD_HTTP_SERVICE_UNAVAILABLE,
+			MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT));
+	}
+
+	MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; version=0.0.4");
+
+	return StatusQueueResponse(conn, MHD_HTTP_OK, res);
+}
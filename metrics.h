@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <microhttpd.h>
+
+#include "state.h"
+
+// Hot path instrumentation exported in Prometheus text format.
+//
+// Counters and histogram buckets are relaxed atomics, recording a value
+// costs a handful of uncontended atomic adds and never takes a lock.
+// /metrics renders into one of a few preallocated buffers that is handed
+// back once MHD has sent it.
+
+#define METRIC_BUCKETS 13
+#define METRIC_PROBE_STATUSES 4	// MAX6675Status values
+
+typedef struct MetricHistogram {
+	atomic_ullong	buckets[METRIC_BUCKETS + 1];	// last one is +Inf
+	atomic_ullong	count;
+	atomic_ullong	sumNs;
+} MetricHistogram;
+
+typedef enum {
+	METRIC_PATH_STATUS,
+	METRIC_PATH_EVENTS,
+	METRIC_PATH_HISTORY,
+	METRIC_PATH_METRICS,
+	METRIC_PATH_TARGET_TEMPERATURE,
+	METRIC_PATH_TARGET_STATE,
+	METRIC_PATH_CURRENT_TEMPERATURE,
+	METRIC_PATH_CONTROLLER,
+	METRIC_PATH_CONTROLLER_GAINS,
+	METRIC_PATH_AUTOTUNE,
+	METRIC_PATH_V2_STATE,
+	METRIC_PATH_ZONES,
+	METRIC_PATH_OTHER,
+	METRIC_PATHS
+} MetricPath;
+
+typedef struct Metrics {
+	MetricHistogram	spiRead;
+	atomic_ullong	probeReads[STATE_MAX_PROBES][METRIC_PROBE_STATUSES];
+
+	MetricHistogram	loopDuration;
+	MetricHistogram	loopJitter;
+	atomic_ullong	loopOverruns;
+
+	atomic_ullong	pwmWrites;
+	atomic_ullong	pwmHeld;
+	atomic_ullong	lidEvents;
+
+	atomic_ullong	tachEdges;
+	atomic_ullong	tachBounced;
+	atomic_ullong	tachDropped;
+
+	atomic_ullong	logDropped;
+	atomic_ullong	logLimited;
+
+	atomic_ullong	httpRequests[METRIC_PATHS];
+	MetricHistogram	httpLatency[METRIC_PATHS];
+} Metrics;
+
+extern Metrics metrics;
+
+
+static inline void MetricInc(atomic_ullong* counter) {
+	atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static inline void MetricSet(atomic_ullong* counter, unsigned long long value) {
+	atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+void MetricObserve(MetricHistogram* histogram, uint64_t ns);
+
+MetricPath MetricPathFor(const char* url);
+
+uint64_t MetricNow(void);
+
+// Renders and queues /metrics, 503 when every buffer is still in flight
+int MetricsQueue(struct MHD_Connection* conn);
+
+#endif
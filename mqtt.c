@@ -0,0 +1,345 @@
+#include <stdio.h>
+
+#include "log.h"
+#include "mqtt.h"
+
+
+#ifdef HAVE_MOSQUITTO
+
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mosquitto.h>
+
+#include "MAX6675.h"
+#include "controller.h"
+#include "state.h"
+#include "status.h"
+
+#define MQTT_TOPIC_MAX  160
+#define MQTT_BODY_MAX   1024	// the whole /status body
+#define MQTT_FIELDS     (10 + 2 * STATE_MAX_PROBES)
+
+typedef struct Field {
+	char	name[40];
+	char	value[32];
+} Field;
+
+static MqttConfig config;
+static MqttCommand command;
+static struct mosquitto* mosq;
+static atomic_bool connected;
+
+// heartThread to publisher hand off
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static unsigned long version;
+static bool resync;		// the broker may have lost the retained topics, send everything
+static bool stopping;
+static pthread_t publishTid;
+
+// Publisher state, only touched by publish_thread
+static Field last[MQTT_FIELDS];
+
+static void publish(const char* suffix, const char* payload, size_t len, bool retain) {
+	char topic[MQTT_TOPIC_MAX];
+
+	snprintf(topic, sizeof(topic), "%s/%s", config.prefix, suffix);
+	int rc = mosquitto_publish(mosq, NULL, topic, len, payload, config.qos, retain);
+	if (rc != MOSQ_ERR_SUCCESS) {
+		Log(LOG_LEVEL_DEBUG, "mqtt : publish %s failed: %s", topic, mosquitto_strerror(rc));
+	}
+}
+
+static void field(Field* f, const char* name, const char* fmt, ...) {
+	va_list args;
+
+	snprintf(f->name, sizeof(f->name), "state/%s", name);
+	va_start(args, fmt);
+	vsnprintf(f->value, sizeof(f->value), fmt, args);
+	va_end(args);
+}
+
+// Renders the per field topics, always in the same order so they can be
+// compared with the last ones sent by index
+static int render_fields(const BBQState* s, Field fields[]) {
+	Field* f = fields;
+
+	field(f++, "targetTemperature", "%.2f", s->targetTemp);
+	field(f++, "targetHeatingCoolingState", "%d", s->targetState);
+	field(f++, "currentTemperature", "%.2f", s->currentTemp);
+	field(f++, "currentHeatingCoolingState", "%d", s->currentState);
+	field(f++, "fanSpeed", "%.1f", s->speed);
+	field(f++, "rpm", "%d", s->rpm);
+	field(f++, "fanStalled", "%s", s->fanStalled ? "true" : "false");
+	field(f++, "lidOpen", "%s", s->lidOpen ? "true" : "false");
+	field(f++, "fault", "%s", (s->fault != MAX6675_OK) ? MAX6675StatusStr(s->fault) : "none");
+	field(f++, "controller", "%s", ControllerName(s->controller));
+
+	for (int i = 0; i < s->probeCount; i++) {
+		char name[24];
+
+		snprintf(name, sizeof(name), "probe/%d/temperature", i);
+		field(f++, name, isnan(s->probeTemps[i]) ? "null" : "%.2f", s->probeTemps[i]);
+		snprintf(name, sizeof(name), "probe/%d/eta", i);
+		field(f++, name, (s->etaSeconds[i] < 0.0) ? "null" : "%.0f", s->etaSeconds[i]);
+	}
+
+	return f - fields;
+}
+
+static void publish_state(bool everything) {
+	BBQState state;
+	char body[MQTT_BODY_MAX];
+	Field fields[MQTT_FIELDS];
+
+	StateRead(&state);
+
+	bool changed = false;
+	int n = render_fields(&state, fields);
+	for (int i = 0; i < n; i++) {
+		if (everything || strcmp(fields[i].value, last[i].value) || strcmp(fields[i].name, last[i].name)) {
+			publish(fields[i].name, fields[i].value, strlen(fields[i].value), true);
+			last[i] = fields[i];
+			changed = true;
+		}
+	}
+
+	// The PID terms in the full body move every cycle, so it goes out
+	// only along with a change to one of the fields
+	int len = changed ? StatusRender(body, sizeof(body), &state) : -1;
+	if (len >= 0) {
+		publish("state", body, len, true);
+	}
+}
+
+static void* publish_thread(void* arg) {
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&lock);
+	while (!stopping) {
+		if (version == seen) {
+			pthread_cond_wait(&wake, &lock);
+			continue;
+		}
+		seen = version;
+		bool everything = resync;
+		resync = false;
+		pthread_mutex_unlock(&lock);
+
+		if (atomic_load(&connected)) {
+			publish_state(everything);
+		}
+
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+
+	return arg;
+}
+
+static void report(const char* topic, const char* error) {
+	char body[256];
+	size_t len = 0;
+
+	Log(LOG_LEVEL_WARN, "mqtt : %s rejected: %s", topic, error);
+	if (StatusAppend(body, sizeof(body), &len, "{\"topic\": ")
+		&& StatusAppendString(body, sizeof(body), &len, topic)
+		&& StatusAppend(body, sizeof(body), &len, ",\"error\": ")
+		&& StatusAppendString(body, sizeof(body), &len, error)
+		&& StatusAppend(body, sizeof(body), &len, "}")) {
+		publish("error", body, len, false);
+	}
+}
+
+// <prefix>/set/<name> with a bare value, wrapped into a one member object.
+// Anything that isn't a number is taken as a string.
+static bool set_field(const char* name, const char* payload, size_t len, const char** error) {
+	char value[64];
+	char json[160];
+	char* end;
+
+	if (len >= sizeof(value)) {
+		*error = "value too long";
+		return false;
+	}
+	memcpy(value, payload, len);
+	value[len] = '\0';
+
+	for (const char* c = name; *c; c++) {
+		if (!isalnum((unsigned char)*c) && *c != '.') {
+			*error = "unknown field";
+			return false;
+		}
+	}
+
+	strtod(value, &end);
+	bool number = end != value && *end == '\0';
+	for (const char* c = value; !number && *c; c++) {
+		if (*c == '"' || *c == '\\' || (unsigned char)*c < ' ') {
+			*error = "invalid value";
+			return false;
+		}
+	}
+
+	int n = snprintf(json, sizeof(json), number ? "{\"%s\": %s}" : "{\"%s\": \"%s\"}", name, value);
+	if (n < 0 || (size_t)n >= sizeof(json)) {
+		*error = "unknown field";
+		return false;
+	}
+	return command(json, n, error);
+}
+
+static void on_message(struct mosquitto* m, void* obj, const struct mosquitto_message* message) {
+	char set[MQTT_TOPIC_MAX];
+	const char* error = "rejected";
+	bool ok = false;
+
+	int setLen = snprintf(set, sizeof(set), "%s/set", config.prefix);
+
+	if (!strcmp(message->topic, set)) {
+		ok = command(message->payload, message->payloadlen, &error);
+	}
+	else if (!strncmp(message->topic, set, setLen) && message->topic[setLen] == '/') {
+		ok = set_field(message->topic + setLen + 1, message->payload, message->payloadlen, &error);
+	}
+
+	if (!ok) {
+		report(message->topic, error);
+	}
+}
+
+static void on_connect(struct mosquitto* m, void* obj, int rc) {
+	char topic[MQTT_TOPIC_MAX];
+
+	if (rc != 0) {
+		Log(LOG_LEVEL_WARN, "mqtt : %s refused the connection: %s", config.host, mosquitto_connack_string(rc));
+		return;
+	}
+	Log(LOG_LEVEL_INFO, "mqtt : connected to %s:%d", config.host, config.port);
+
+	snprintf(topic, sizeof(topic), "%s/set", config.prefix);
+	mosquitto_subscribe(m, NULL, topic, config.qos);
+	snprintf(topic, sizeof(topic), "%s/set/+", config.prefix);
+	mosquitto_subscribe(m, NULL, topic, config.qos);
+	publish("online", "1", 1, true);
+
+	atomic_store(&connected, true);
+
+	pthread_mutex_lock(&lock);
+	resync = true;
+	version++;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+}
+
+static void on_disconnect(struct mosquitto* m, void* obj, int rc) {
+	atomic_store(&connected, false);
+	if (rc != 0) {
+		Log(LOG_LEVEL_WARN, "mqtt : lost %s, reconnecting", config.host);
+	}
+}
+
+int MqttSetup(const MqttConfig* mqttConfig, MqttCommand handler) {
+	char will[MQTT_TOPIC_MAX];
+
+	if (mqttConfig->host[0] == '\0') {
+		return 0;
+	}
+	config = *mqttConfig;
+	command = handler;
+
+	mosquitto_lib_init();
+	mosq = mosquitto_new(config.clientId[0] ? config.clientId : NULL, true, NULL);
+	if (mosq == NULL) {
+		Log(LOG_LEVEL_WARN, "mqtt : can't create a client");
+		return -1;
+	}
+
+	mosquitto_connect_callback_set(mosq, on_connect);
+	mosquitto_disconnect_callback_set(mosq, on_disconnect);
+	mosquitto_message_callback_set(mosq, on_message);
+	mosquitto_reconnect_delay_set(mosq, 1, 60, true);
+
+	if (config.username[0]) {
+		mosquitto_username_pw_set(mosq, config.username, config.password[0] ? config.password : NULL);
+	}
+
+	snprintf(will, sizeof(will), "%s/online", config.prefix);
+	mosquitto_will_set(mosq, will, 1, "0", config.qos, true);
+
+	// Asynchronous so a broker that is down doesn't hold up start up, the
+	// network thread keeps retrying
+	int rc = mosquitto_connect_async(mosq, config.host, config.port, config.keepAlive);
+	if (rc != MOSQ_ERR_SUCCESS) {
+		Log(LOG_LEVEL_WARN, "mqtt : can't connect to %s:%d: %s, retrying", config.host, config.port, mosquitto_strerror(rc));
+	}
+
+	stopping = false;
+	if (mosquitto_loop_start(mosq) != MOSQ_ERR_SUCCESS
+		|| pthread_create(&publishTid, NULL, publish_thread, NULL) != 0) {
+		Log(LOG_LEVEL_WARN, "mqtt : can't start the client threads");
+		mosquitto_loop_stop(mosq, true);
+		mosquitto_destroy(mosq);
+		mosq = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void MqttNotify(void) {
+	if (mosq == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	version++;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+}
+
+void MqttClose(void) {
+	if (mosq == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+	pthread_join(publishTid, NULL);
+
+	// A clean disconnect doesn't fire the will, say so ourselves
+	if (atomic_load(&connected)) {
+		publish("online", "0", 1, true);
+	}
+	mosquitto_disconnect(mosq);
+	mosquitto_loop_stop(mosq, false);
+	mosquitto_destroy(mosq);
+	mosquitto_lib_cleanup();
+	mosq = NULL;
+}
+
+#else
+
+int MqttSetup(const MqttConfig* config, MqttCommand command) {
+	if (config->host[0] != '\0') {
+		Log(LOG_LEVEL_WARN, "mqtt : built without libmosquitto, ignoring broker %s", config->host);
+		return -1;
+	}
+	return 0;
+}
+
+void MqttNotify(void) {
+}
+
+void MqttClose(void) {
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// MQTT publisher.
+//
+// A worker thread wakes on every published state version and sends the
+// parts of the snapshot that changed as retained messages, so the broker
+// fans out to any number of consumers without them polling the Pi:
+//
+//   <prefix>/state                 the /status JSON body
+//   <prefix>/state/<field>         targetTemperature, fanSpeed, rpm, ...
+//   <prefix>/state/probe/<n>/...   temperature and eta of each probe
+//   <prefix>/online                1, or 0 as the will once the link drops
+//
+// <prefix>/set takes the same JSON object as POST /v2/state and
+// <prefix>/set/<field> a bare value for one field.  Rejected commands are
+// reported on <prefix>/error.  libmosquitto runs the connection on its own
+// thread and reconnects with back off.  Built when HAVE_MOSQUITTO is
+// defined, without it a configured broker is ignored with a warning.
+
+typedef struct MqttConfig {
+	char	host[64];	// broker, empty disables MQTT
+	int	port;
+	char	clientId[32];
+	char	username[32];	// empty for an anonymous connection
+	char	password[64];
+	char	prefix[64];	// topic root
+	int	keepAlive;	// seconds
+	int	qos;
+} MqttConfig;
+
+// Applies a JSON command object.  Returns false with *error set to a
+// static description if nothing was applied.  Called on the MQTT thread.
+typedef bool (*MqttCommand)(const char* json, size_t len, const char** error);
+
+// Connects in the background and starts the publisher.  Returns -1 if
+// MQTT is configured but could not be started.
+int MqttSetup(const MqttConfig* config, MqttCommand command);
+
+// Called by heartThread after a new state version was published
+void MqttNotify(void);
+
+// Marks the device offline and disconnects
+void MqttClose(void);
+
+#endif
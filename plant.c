@@ -0,0 +1,29 @@
+#include <math.h>
+
+#include "plant.h"
+
+
+double PlantPredict(const PlantConfig* plant, double ambient, double measurement, double duty) {
+	double steady = ambient + plant->gain * duty;
+	double decay = exp(-plant->horizon / plant->tau);
+
+	return steady + (measurement - steady) * decay;
+}
+
+double PlantClamp(const PlantConfig* plant, double ambient, double setPoint, double measurement, double duty) {
+	if (plant->gain <= 0.0 || plant->tau <= 0.0 || plant->horizon <= 0.0) {
+		return duty;
+	}
+
+	double limit = setPoint + plant->margin;
+	if (PlantPredict(plant, ambient, measurement, duty) <= limit) {
+		return duty;
+	}
+
+	// Solve steady + (measurement - steady) * decay = limit for the duty
+	double decay = exp(-plant->horizon / plant->tau);
+	double steady = (limit - measurement * decay) / (1.0 - decay);
+	double max = (steady - ambient) / plant->gain;
+
+	return (max < 0.0) ? 0.0 : (max < duty) ? max : duty;
+}
@@ -0,0 +1,25 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+// First order model of the pit.
+//
+// At a steady duty u the pit settles at ambient + gain * u with time
+// constant tau.  Looking horizon seconds ahead from the current
+// temperature tells whether the duty the controller asks for will carry
+// the pit past the target, and how far it has to come down not to.
+
+typedef struct PlantConfig {
+	double	gain;		// degrees per % duty at steady state, 0 disables the model
+	double	tau;		// seconds
+	double	horizon;	// seconds looked ahead
+	double	margin;		// degrees above the target the prediction may reach
+} PlantConfig;
+
+
+// Temperature predicted horizon seconds ahead at a constant duty
+double PlantPredict(const PlantConfig* plant, double ambient, double measurement, double duty);
+
+// Highest duty, at most duty, whose prediction stays within margin of setPoint
+double PlantClamp(const PlantConfig* plant, double ambient, double setPoint, double measurement, double duty);
+
+#endif
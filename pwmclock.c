@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hal.h"
+#include "pwmclock.h"
+
+
+typedef struct PwmClockEntry {
+	int		baseFreq;
+	int		pwmFreq;
+	PwmClock	clock;
+} PwmClockEntry;
+
+// Smallest divisor giving an exact match, the largest range and so the
+// finest duty steps
+static const PwmClockEntry table[] = {
+	{ PWM_BASE_PI4,    25000, { 2, 1080, true } },	// 4-wire fan spec
+	{ PWM_BASE_PI4,    22500, { 2, 1200, true } },
+	{ PWM_BASE_PI4,    20000, { 2, 1350, true } },
+	{ PWM_BASE_PI4,    30000, { 2,  900, true } },
+	{ PWM_BASE_PI4,     1000, { 2, 27000, true } },
+	{ PWM_BASE_LEGACY, 25000, { 2,  384, true } },
+	{ PWM_BASE_LEGACY, 20000, { 2,  480, true } },
+	{ PWM_BASE_LEGACY, 30000, { 2,  320, true } },
+	{ PWM_BASE_LEGACY,  1000, { 2, 9600, true } },
+};
+
+int PwmBaseFreq(void) {
+	char model[128] = "";
+	FILE* f = fopen("/proc/device-tree/model", "r");
+
+	if (f) {
+		size_t n = fread(model, 1, sizeof(model) - 1, f);
+		model[n] = '\0';
+		fclose(f);
+	}
+
+	if (model[0] != '\0') {
+		bool pi4 = strstr(model, "Raspberry Pi 4 ") || strstr(model, "Raspberry Pi 400")
+			|| strstr(model, "Compute Module 4");
+		return pi4 ? PWM_BASE_PI4 : PWM_BASE_LEGACY;
+	}
+
+	return HalBoardPi4() ? PWM_BASE_PI4 : PWM_BASE_LEGACY;
+}
+
+bool PwmClockFor(int baseFreq, int pwmFreq, PwmClock* out) {
+	if (baseFreq <= 0 || pwmFreq <= 0) {
+		return false;
+	}
+
+	for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+		if (table[i].baseFreq == baseFreq && table[i].pwmFreq == pwmFreq) {
+			*out = table[i].clock;
+			return true;
+		}
+	}
+
+	int ratio = baseFreq / pwmFreq;
+	int maxRange = baseFreq / 2;
+
+	// The first divisor of ratio gives the largest range
+	if (baseFreq % pwmFreq == 0) {
+		for (int clock = 2; clock <= 4095 && clock <= ratio; clock++) {
+			if (ratio % clock == 0) {
+				out->clock = clock;
+				out->range = ratio / clock;
+				out->exact = true;
+				return true;
+			}
+		}
+	}
+
+	// No exact match, get a similar frequency
+	int clock = ratio / maxRange;
+	clock = (clock < 2) ? 2 : (clock > 4095) ? 4095 : clock;
+
+	out->clock = clock;
+	out->range = ratio / clock;
+	out->exact = false;
+	return out->range >= 1 && out->range <= maxRange;
+}
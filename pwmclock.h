@@ -0,0 +1,30 @@
+#ifndef PWMCLOCK_H
+#define PWMCLOCK_H
+
+#include <stdbool.h>
+
+// PWM clock divisor and range for a fan frequency.
+//
+// The PWM block runs off the board oscillator, 54 MHz on the Pi 4 family
+// and 19.2 MHz before it.  Output frequency is base / clock / range with
+// clock in 2..4095, common fan frequencies come from a table and anything
+// else is searched for.
+
+#define PWM_BASE_PI4	54000000
+#define PWM_BASE_LEGACY	19200000
+
+typedef struct PwmClock {
+	int	clock;		// divisor, 2..4095
+	int	range;		// counts per PWM period
+	bool	exact;		// base / clock / range is exactly the frequency asked for
+} PwmClock;
+
+
+// Oscillator of the board we are running on, from the device tree model
+// or wiringPi's board id
+int PwmBaseFreq(void);
+
+// Returns false if the frequency can't be reached from baseFreq
+bool PwmClockFor(int baseFreq, int pwmFreq, PwmClock* out);
+
+#endif
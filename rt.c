@@ -0,0 +1,101 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "rt.h"
+
+
+#define RT_PREFAULT_STACK (64 * 1024)
+#define RT_STACK_SIZE     (256 * 1024)	// locked in full, the 8 MB default would pin megabytes per thread
+
+static void prefault_stack(void) {
+	volatile unsigned char stack[RT_PREFAULT_STACK];
+
+	for (size_t i = 0; i < sizeof(stack); i += 4096) {
+		stack[i] = 0;
+	}
+}
+
+int RtLockMemory(void) {
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		Log(LOG_LEVEL_WARN, "rt : mlockall failed, %s", strerror(errno));
+		return -1;
+	}
+	prefault_stack();
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, RT_STACK_SIZE);
+	pthread_setattr_default_np(&attr);
+	pthread_attr_destroy(&attr);
+	return 0;
+}
+
+static int create(pthread_t* tid, void* (*fn)(void*), void* arg, int priority, int cpu) {
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if (priority > 0) {
+		struct sched_param param = { .sched_priority = priority };
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	} else {
+		// Don't pass on a real-time policy of the creating thread
+		struct sched_param param = { .sched_priority = 0 };
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	if (cpu >= 0 && cpu < RT_MAX_CPUS) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+
+	int ret = pthread_create(tid, &attr, fn, arg);
+	pthread_attr_destroy(&attr);
+	return ret;
+}
+
+int RtThreadStart(pthread_t* tid, const char* name, void* (*fn)(void*), void* arg, int priority, int cpu) {
+	int ret = create(tid, fn, arg, priority, cpu);
+
+	if (ret == EPERM || ret == EINVAL) {
+		Log(LOG_LEVEL_WARN, "rt : %s can't run at priority %d on cpu %d (%s), using normal scheduling",
+			name, priority, cpu, strerror(ret));
+		ret = create(tid, fn, arg, 0, -1);
+	}
+
+	if (ret == 0) {
+		pthread_setname_np(*tid, name);
+	}
+	return ret;
+}
+
+void RtAvoidCpus(const int cpus[], int count) {
+	cpu_set_t set;
+
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+		return;
+	}
+
+	cpu_set_t keep = set;
+	for (int i = 0; i < count; i++) {
+		if (cpus[i] >= 0 && cpus[i] < RT_MAX_CPUS) {
+			CPU_CLR(cpus[i], &keep);
+		}
+	}
+
+	// Leave the mask alone rather than have nowhere left to run
+	if (CPU_COUNT(&keep) > 0) {
+		pthread_setaffinity_np(pthread_self(), sizeof(keep), &keep);
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef RT_H
+#define RT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Real-time scheduling for the control path.
+//
+// The acquisition and control threads run SCHED_FIFO on cores of their
+// own, everything else (HTTP, cook log) keeps normal scheduling and is
+// kept off those cores.  Without the privileges for either the threads
+// still run, with a warning, under the normal scheduler.
+
+#define RT_MAX_CPUS 64
+
+// Locks current and future pages in memory and pre-faults stack, so the
+// control path never stalls on a page fault.  Threads started afterwards
+// default to a small stack since all of it gets locked.  Returns -1 on
+// failure.
+int RtLockMemory(void);
+
+// Starts fn with SCHED_FIFO priority (0 for normal scheduling) pinned to
+// cpu (-1 for any).  Returns the pthread_create result.
+int RtThreadStart(pthread_t* tid, const char* name, void* (*fn)(void*), void* arg, int priority, int cpu);
+
+// Keeps the calling thread, and threads it starts later, off the given
+// cpus.  Negative entries are ignored.
+void RtAvoidCpus(const int cpus[], int count);
+
+#endif
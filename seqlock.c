@@ -0,0 +1,45 @@
+#include <string.h>
+
+#include "seqlock.h"
+
+
+void SeqLockWrite(SeqLock* lock, const void* src) {
+	const unsigned char* in = src;
+	unsigned int seq = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&lock->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	for (size_t i = 0, off = 0; off < lock->size; i++, off += sizeof(unsigned long)) {
+		unsigned long word = 0;
+		size_t n = (lock->size - off < sizeof(word)) ? lock->size - off : sizeof(word);
+		memcpy(&word, in + off, n);
+		atomic_store_explicit(&lock->data[i], word, memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&lock->seq, seq + 2, memory_order_release);
+}
+
+// Returns the publish count of the copy, 0 if nothing was published yet
+unsigned int SeqLockRead(SeqLock* lock, void* dst) {
+	unsigned char* out = dst;
+	unsigned int start, end;
+
+	do {
+		start = atomic_load_explicit(&lock->seq, memory_order_acquire);
+		if (start & 1) {
+			continue;
+		}
+
+		for (size_t i = 0, off = 0; off < lock->size; i++, off += sizeof(unsigned long)) {
+			unsigned long word = atomic_load_explicit(&lock->data[i], memory_order_relaxed);
+			size_t n = (lock->size - off < sizeof(word)) ? lock->size - off : sizeof(word);
+			memcpy(out + off, &word, n);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		end = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+	} while ((start & 1) || start != end);
+
+	return start / 2;
+}
@@ -0,0 +1,32 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Single writer / many reader sequence lock.
+//
+// The writer never waits; readers copy the payload and retry if a
+// publish overlapped their copy.  The payload is kept in atomic words so
+// the racing copy is well defined.  Writers must be serialised by the
+// caller if more than one thread publishes.
+
+typedef struct SeqLock {
+	atomic_uint	seq;
+	size_t		size;
+	atomic_ulong*	data;
+} SeqLock;
+
+#define SEQLOCK_WORDS(type) ((sizeof(type) + sizeof(unsigned long) - 1) / sizeof(unsigned long))
+
+#define SEQLOCK_DEFINE(name, type) \
+	static atomic_ulong name##_data[SEQLOCK_WORDS(type)]; \
+	static SeqLock name = { 0, sizeof(type), name##_data }
+
+// Initialiser for a lock over data[SEQLOCK_WORDS(type)], for arrays of locks
+#define SEQLOCK_INIT(type, data) { 0, sizeof(type), data }
+
+void SeqLockWrite(SeqLock* lock, const void* src);
+unsigned int SeqLockRead(SeqLock* lock, void* dst);
+
+#endif
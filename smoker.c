@@ -0,0 +1,98 @@
+#include <math.h>
+
+#include "smoker.h"
+
+
+#define SMOKER_SUBSTEP_S   0.1	// longest step the model is integrated over
+#define SMOKER_EMBERS      0.25	// the fire fades over its last quarter of fuel
+#define SMOKER_STALL_LOW   65.0	// degrees, meat surface evaporation range
+#define SMOKER_STALL_HIGH  75.0
+#define SMOKER_STALL_SLOW  0.25	// how much of the heat reaches the meat meanwhile
+
+// xorshift32, deterministic for a given seed
+static double uniform(Smoker* smoker) {
+	unsigned int x = smoker->rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	smoker->rng = x;
+	return (x >> 8) / 16777216.0;
+}
+
+static double gaussian(Smoker* smoker) {
+	double u = uniform(smoker);
+	double v = uniform(smoker);
+
+	return sqrt(-2.0 * log(u + 1e-12)) * cos(2.0 * M_PI * v);
+}
+
+static double exponential(Smoker* smoker, double mean) {
+	return -mean * log(1.0 - uniform(smoker));
+}
+
+void SmokerSetup(Smoker* smoker, const SmokerConfig* config) {
+	smoker->config = *config;
+	smoker->t = 0.0;
+	smoker->pit = config->ambient;
+	smoker->meat = config->meatStart;
+	smoker->fuel = config->fuelKg;
+	smoker->air = 0.0;
+	smoker->lidUntil = 0.0;
+	smoker->lidEvents = 0;
+	smoker->rng = config->seed ? config->seed : 1;
+	smoker->nextLid = (config->lidEveryS > 0.0) ? exponential(smoker, config->lidEveryS) : INFINITY;
+}
+
+static void step(Smoker* smoker, double duty, double dt) {
+	const SmokerConfig* c = &smoker->config;
+
+	double target = (duty >= c->fanMinDuty) ? duty / 100.0 : 0.0;
+	smoker->air += (target - smoker->air) * (1.0 - exp(-dt / fmax(c->fanLagS, 1e-3)));
+
+	double flow = c->idleAir + (1.0 - c->idleAir) * smoker->air;
+	double fire = fmin(1.0, smoker->fuel / fmax(SMOKER_EMBERS * c->fuelKg, 1e-6));
+	double loss = c->loss + (SmokerLidOpen(smoker) ? c->lidLoss : 0.0);
+
+	smoker->pit += (c->heatGain * flow * fire - loss * (smoker->pit - c->ambient)) * dt;
+	smoker->fuel = fmax(0.0, smoker->fuel - c->burnRate / 3600.0 * flow * dt);
+
+	double rate = (smoker->pit - smoker->meat) / fmax(c->meatTauS, 1.0);
+	if (smoker->meat >= SMOKER_STALL_LOW && smoker->meat <= SMOKER_STALL_HIGH) {
+		rate *= SMOKER_STALL_SLOW;
+	}
+	smoker->meat += rate * dt;
+
+	smoker->t += dt;
+	if (smoker->t >= smoker->nextLid) {
+		smoker->lidUntil = smoker->t + c->lidOpenS;
+		smoker->nextLid = smoker->t + c->lidOpenS + exponential(smoker, c->lidEveryS);
+		smoker->lidEvents++;
+	}
+}
+
+void SmokerStep(Smoker* smoker, double duty, double dt) {
+	while (dt > 0.0) {
+		double h = fmin(dt, SMOKER_SUBSTEP_S);
+		step(smoker, duty, h);
+		dt -= h;
+	}
+}
+
+bool SmokerLidOpen(const Smoker* smoker) {
+	return smoker->t < smoker->lidUntil;
+}
+
+double SmokerRpm(const Smoker* smoker) {
+	return smoker->air * smoker->config.fanMaxRpm;
+}
+
+double SmokerProbe(Smoker* smoker, int probe) {
+	double noise = smoker->config.noise * gaussian(smoker);
+
+	switch (probe) {
+		case 0:	return smoker->pit + noise;
+		case 1:	return smoker->meat + noise;
+		default: return NAN;
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef SMOKER_H
+#define SMOKER_H
+
+#include <stdbool.h>
+
+// Thermal model of a charcoal smoker, what the simulated HAL reads.
+//
+// The pit is one lumped mass: heat from the fire grows with the airflow
+// through it and falls off as the fuel burns down, losses to ambient grow
+// with the pit temperature and jump while the lid is open.  The fan spins
+// up and down through a first order lag and does nothing below its
+// starting duty.  Probe 0 is the pit, probe 1 a meat probe that follows
+// the pit slowly and stalls while its surface water evaporates.
+
+typedef struct SmokerConfig {
+	double		speed;		// simulated seconds per real second, 0 for as fast as possible
+	double		ambient;	// degrees
+	double		meatStart;	// degrees, out of the fridge
+	double		fuelKg;		// charcoal at light up
+	double		burnRate;	// kg/h with the fan flat out
+	double		heatGain;	// degrees/s of heating at full airflow and a full fire
+	double		idleAir;	// airflow through the vents with the fan stopped, 0-1
+	double		loss;		// 1/s, heat lost to ambient per degree above it
+	double		fanLagS;	// time constant of the airflow following the duty
+	double		fanMinDuty;	// % below which the fan doesn't turn
+	double		fanMaxRpm;
+	int		pulsesPerRev;	// tach pulses, set from [tach] pulse
+	double		lidEveryS;	// mean seconds between lid openings, 0 for none
+	double		lidOpenS;	// how long the lid stays open
+	double		lidLoss;	// extra loss while open, 1/s
+	double		meatTauS;	// time constant of the meat probe
+	double		noise;		// degrees, standard deviation on probe readings
+	unsigned int	seed;
+} SmokerConfig;
+
+typedef struct Smoker {
+	SmokerConfig	config;
+
+	double		t;		// seconds since light up
+	double		pit;
+	double		meat;
+	double		fuel;		// kg left
+	double		air;		// fan airflow, 0-1
+	double		lidUntil;	// t the current opening ends
+	double		nextLid;
+	unsigned long	lidEvents;
+	unsigned int	rng;
+} Smoker;
+
+
+void SmokerSetup(Smoker* smoker, const SmokerConfig* config);
+
+// Advances the model by dt seconds with the fan at duty %
+void SmokerStep(Smoker* smoker, double duty, double dt);
+
+bool SmokerLidOpen(const Smoker* smoker);
+double SmokerRpm(const Smoker* smoker);
+
+// Reading of probe with sensor noise, NAN for a probe that isn't fitted
+double SmokerProbe(Smoker* smoker, int probe);
+
+#endif
@@ -0,0 +1,48 @@
+#include <errno.h>
+#include <string.h>
+
+#include "spsc.h"
+
+
+int SpscSetup(Spsc* queue) {
+	atomic_store(&queue->head, 0);
+	atomic_store(&queue->tail, 0);
+	atomic_store(&queue->dropped, 0);
+	return sem_init(&queue->ready, 0, 0);
+}
+
+bool SpscPush(Spsc* queue, const void* item) {
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	if (head - tail >= queue->count) {
+		atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+
+	memcpy(queue->items + (head & (queue->count - 1)) * queue->size, item, queue->size);
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	sem_post(&queue->ready);
+	return true;
+}
+
+bool SpscPop(Spsc* queue, void* item) {
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+	if (tail == head) {
+		return false;
+	}
+
+	memcpy(item, queue->items + (tail & (queue->count - 1)) * queue->size, queue->size);
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+void SpscWait(Spsc* queue) {
+	while (sem_wait(&queue->ready) != 0 && errno == EINTR);
+}
+
+void SpscWake(Spsc* queue) {
+	sem_post(&queue->ready);
+}
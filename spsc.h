@@ -0,0 +1,43 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Single producer / single consumer queue of fixed size items.
+//
+// Push and pop are lock free, each side only writes its own index.  A
+// consumer with nothing to do can block in SpscWait, the producer posts
+// a semaphore per item which costs no lock while nobody is waiting.
+// count must be a power of two.
+
+typedef struct Spsc {
+	atomic_uint	head;	// written by the producer
+	atomic_uint	tail;	// written by the consumer
+	unsigned int	count;
+	size_t		size;
+	unsigned char*	items;
+	atomic_ulong	dropped;
+	sem_t		ready;
+} Spsc;
+
+#define SPSC_DEFINE(name, type, items) \
+	static unsigned char name##_items[(items) * sizeof(type)]; \
+	static Spsc name = { 0, 0, items, sizeof(type), name##_items, 0 }
+
+// Must run before either side uses the queue
+int SpscSetup(Spsc* queue);
+
+// Returns false and counts a drop when the queue is full
+bool SpscPush(Spsc* queue, const void* item);
+
+// Returns false when the queue is empty
+bool SpscPop(Spsc* queue, void* item);
+
+// Blocks until an item was pushed, or for a wake up
+void SpscWait(Spsc* queue);
+void SpscWake(Spsc* queue);
+
+#endif
@@ -0,0 +1,27 @@
+#include "seqlock.h"
+#include "state.h"
+
+
+static atomic_ulong stateData[STATE_MAX_ZONES][SEQLOCK_WORDS(BBQState)];
+static SeqLock stateLocks[STATE_MAX_ZONES] = {
+	SEQLOCK_INIT(BBQState, stateData[0]),
+	SEQLOCK_INIT(BBQState, stateData[1]),
+};
+
+_Static_assert(STATE_MAX_ZONES == 2, "one stateLocks initialiser per zone");
+
+void StatePublish(const BBQState* state) {
+	SeqLockWrite(&stateLocks[0], state);
+}
+
+unsigned int StateRead(BBQState* state) {
+	return SeqLockRead(&stateLocks[0], state);
+}
+
+void StatePublishZone(int zone, const BBQState* state) {
+	SeqLockWrite(&stateLocks[zone], state);
+}
+
+unsigned int StateReadZone(int zone, BBQState* state) {
+	return SeqLockRead(&stateLocks[zone], state);
+}
@@ -0,0 +1,46 @@
+#ifndef STATE_H
+#define STATE_H
+
+// Consistent copy of the controller state.
+//
+// heartThread fills one in per cycle and publishes it; HTTP handlers take
+// a copy without ever blocking the control loop.
+
+#define STATE_MAX_PROBES 2	// one per SPI chip select
+#define STATE_MAX_ZONES  STATE_MAX_PROBES	// each zone needs a pit probe of its own
+
+typedef struct BBQState {
+	int	targetState;
+	double	targetTemp;
+	int	currentState;
+	double	currentTemp;
+	int	probeCount;
+	float	probeTemps[STATE_MAX_PROBES];	// NAN for a probe that could not be read
+	int	probeStatus[STATE_MAX_PROBES];	// MAX6675Status of each reading
+	float	etaSeconds[STATE_MAX_PROBES];	// meat probe done estimate, < 0 when there is none
+	int	probeStalled[STATE_MAX_PROBES];
+	int	fault;		// MAX6675Status latched on the control probe, 0 when healthy
+	double	speed;
+	int	rpm;
+	int	fanStalled;
+	int	lidOpen;
+	int	controller;	// ControllerType
+	double	pidP;
+	double	pidI;
+	double	pidD;
+	double	pidFF;
+} BBQState;
+
+
+// Zone 0, the one the root endpoints, events and MQTT follow
+void StatePublish(const BBQState* state);
+
+// Copies the latest snapshot into state and returns its version, 0 before
+// the first publish
+unsigned int StateRead(BBQState* state);
+
+// The same for any zone, each has a snapshot of its own
+void StatePublishZone(int zone, const BBQState* state);
+unsigned int StateReadZone(int zone, BBQState* state);
+
+#endif
@@ -0,0 +1,257 @@
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MAX6675.h"
+#include "controller.h"
+#include "status.h"
+
+
+#define STATUS_MAX_LEN 1024
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static struct MHD_Response* cached = NULL;
+static char lastBody[STATUS_MAX_LEN];
+static char cachedTag[32];		// ETag of cached, under cacheLock
+static unsigned int bootNonce;		// sets this run's tags apart from the last run's
+static bool closeConnection = false;
+
+void StatusSetup(bool keepAlive) {
+	closeConnection = !keepAlive;
+
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || read(fd, &bootNonce, sizeof(bootNonce)) != sizeof(bootNonce)) {
+		bootNonce = (unsigned int)time(NULL) ^ ((unsigned int)getpid() << 16);
+	}
+	if (fd >= 0) close(fd);
+}
+
+// FNV-1a, the tag only has to tell bodies apart
+static unsigned long long body_hash(const char* body, int len) {
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (int i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char)body[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool StatusAppend(char* buf, size_t size, size_t* len, const char* fmt, ...) {
+	va_list args;
+
+	va_start(args, fmt);
+	int n = vsnprintf(buf + *len, size - *len, fmt, args);
+	va_end(args);
+
+	if (n < 0 || (size_t)n >= size - *len) {
+		return false;
+	}
+	*len += n;
+	return true;
+}
+
+bool StatusAppendString(char* buf, size_t size, size_t* len, const char* text) {
+	bool ok = StatusAppend(buf, size, len, "\"");
+
+	for (const char* c = text; ok && *c; c++) {
+		unsigned char ch = (unsigned char)*c;
+		ok = (ch == '"' || ch == '\\') ? StatusAppend(buf, size, len, "\\%c", ch)
+			: (ch < ' ') ? StatusAppend(buf, size, len, "\\u%04x", ch)
+			: StatusAppend(buf, size, len, "%c", ch);
+	}
+	return ok && StatusAppend(buf, size, len, "\"");
+}
+
+// Renders the probe arrays, returns the length written or -1 if it did not fit
+static int render_probes(char* buf, size_t size, const BBQState* state) {
+	size_t len = 0;
+	bool ok = true;
+
+	for (int i = 0; ok && i < state->probeCount; i++) {
+		ok = isnan(state->probeTemps[i])
+			? StatusAppend(buf, size, &len, "%snull", i ? "," : "")
+			: StatusAppend(buf, size, &len, "%s%.2f", i ? "," : "", state->probeTemps[i]);
+	}
+
+	ok = ok && StatusAppend(buf, size, &len, "],\"probeStatus\": [");
+
+	for (int i = 0; ok && i < state->probeCount; i++) {
+		ok = StatusAppend(buf, size, &len, "%s\"%s\"", i ? "," : "", MAX6675StatusStr(state->probeStatus[i]));
+	}
+
+	ok = ok && StatusAppend(buf, size, &len, "],\"etaSeconds\": [");
+
+	for (int i = 0; ok && i < state->probeCount; i++) {
+		ok = (state->etaSeconds[i] < 0.0)
+			? StatusAppend(buf, size, &len, "%snull", i ? "," : "")
+			: StatusAppend(buf, size, &len, "%s%.0f", i ? "," : "", state->etaSeconds[i]);
+	}
+
+	ok = ok && StatusAppend(buf, size, &len, "],\"probeStalled\": [");
+
+	for (int i = 0; ok && i < state->probeCount; i++) {
+		ok = StatusAppend(buf, size, &len, "%s%s", i ? "," : "", state->probeStalled[i] ? "true" : "false");
+	}
+
+	return ok ? (int)len : -1;
+}
+
+int StatusRender(char* buf, size_t size, const BBQState* state) {
+	char probes[80 * STATE_MAX_PROBES + 64];
+	char fault[40] = "null";
+
+	if (render_probes(probes, sizeof(probes), state) < 0) {
+		return -1;
+	}
+	if (state->fault != MAX6675_OK) {
+		snprintf(fault, sizeof(fault), "\"%s\"", MAX6675StatusStr(state->fault));
+	}
+
+	int len = snprintf(buf, size,
+		"{\"targetHeatingCoolingState\": %d,\"targetTemperature\": %.2f,\"currentHeatingCoolingState\": %d,\"currentTemperature\": %.2f,"
+		"\"probeTemperatures\": [%s],\"fault\": %s,"
+		"\"fanSpeed\": %.1f,\"rpm\": %d,\"fanStalled\": %s,\"lidOpen\": %s,\"controller\": \"%s\",\"pidP\": %.2f,\"pidI\": %.2f,\"pidD\": %.2f,\"pidFF\": %.2f}",
+		state->targetState, state->targetTemp,
+		state->currentState, state->currentTemp,
+		probes, fault,
+		state->speed, state->rpm, state->fanStalled ? "true" : "false", state->lidOpen ? "true" : "false", ControllerName(state->controller),
+		state->pidP, state->pidI, state->pidD, state->pidFF);
+
+	return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+static struct MHD_Response* create_response(const char* body, int len, enum MHD_ResponseMemoryMode mode) {
+	struct MHD_Response* res = MHD_create_response_from_buffer(len, (void*)body, mode);
+
+	if (res) {
+		MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, "application/json");
+		MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE, "application/json");
+	}
+	return res;
+}
+
+int StatusQueueResponse(struct MHD_Connection* conn, unsigned int code, struct MHD_Response* res) {
+	if (res == NULL) {
+		return MHD_NO;
+	}
+	if (closeConnection) MHD_add_response_header(res, "Connection", "close");
+
+	int ret = MHD_queue_response(conn, code, res);
+	MHD_destroy_response(res);
+	return ret;
+}
+
+void StatusUpdate(const BBQState* state) {
+	char body[STATUS_MAX_LEN];
+	int len = StatusRender(body, sizeof(body), state);
+
+	// Only the control loop writes lastBody, no lock needed for the compare
+	if (len < 0 || (cached && !strcmp(body, lastBody))) {
+		return;
+	}
+
+	char* copy = malloc(len + 1);
+	if (copy == NULL) {
+		return;
+	}
+	memcpy(copy, body, len + 1);
+
+	struct MHD_Response* res = create_response(copy, len, MHD_RESPMEM_MUST_FREE);
+	if (res == NULL) {
+		free(copy);
+		return;
+	}
+
+	// The tag follows the body, the same body gets the same tag within a
+	// run and the boot nonce makes every tag new after a restart.  The pit
+	// temperature and PID terms are in the body, so while the controller
+	// is working the tag changes most cycles, a 304 needs a settled pit.
+	char tag[sizeof(cachedTag)];
+	snprintf(tag, sizeof(tag), "\"%08x-%016llx\"", bootNonce, body_hash(body, len));
+	MHD_add_response_header(res, MHD_HTTP_HEADER_ETAG, tag);
+	// Shared by every request, so it can't go through StatusQueueResponse
+	if (closeConnection) MHD_add_response_header(res, "Connection", "close");
+
+	pthread_mutex_lock(&cacheLock);
+	struct MHD_Response* old = cached;
+	cached = res;
+	memcpy(cachedTag, tag, sizeof(tag));
+	pthread_mutex_unlock(&cacheLock);
+
+	memcpy(lastBody, body, len + 1);
+
+	// Drops our reference, responses still queued on a connection live on
+	if (old) MHD_destroy_response(old);
+}
+
+int StatusQueue(struct MHD_Connection* conn) {
+	int ret = MHD_NO;
+
+	pthread_mutex_lock(&cacheLock);
+	if (cached) {
+		ret = MHD_queue_response(conn, MHD_HTTP_OK, cached);
+	}
+	pthread_mutex_unlock(&cacheLock);
+
+	return ret;
+}
+
+int StatusQueueConditional(struct MHD_Connection* conn) {
+	const char* match = MHD_lookup_connection_value(conn, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+	int ret = MHD_NO;
+
+	pthread_mutex_lock(&cacheLock);
+	if (cached && match && strstr(match, cachedTag)) {
+		struct MHD_Response* res = MHD_create_response_from_buffer(0, "", MHD_RESPMEM_PERSISTENT);
+		if (res) MHD_add_response_header(res, MHD_HTTP_HEADER_ETAG, cachedTag);
+		ret = StatusQueueResponse(conn, MHD_HTTP_NOT_MODIFIED, res);
+	}
+	else if (cached) {
+		ret = MHD_queue_response(conn, MHD_HTTP_OK, cached);
+	}
+	pthread_mutex_unlock(&cacheLock);
+
+	return ret;
+}
+
+int StatusQueueError(struct MHD_Connection* conn, unsigned int code, const char* message) {
+	char body[192];
+	size_t len = 0;
+
+	if (!StatusAppend(body, sizeof(body), &len, "{\"error\": ")
+		|| !StatusAppendString(body, sizeof(body), &len, message)
+		|| !StatusAppend(body, sizeof(body), &len, "}")) {
+		return MHD_NO;
+	}
+
+	return StatusQueueResponse(conn, code, create_response(body, len, MHD_RESPMEM_MUST_COPY));
+}
+
+int StatusQueueState(struct MHD_Connection* conn, const BBQState* state) {
+	char body[STATUS_MAX_LEN];
+
+	return StatusQueueBody(conn, body, StatusRender(body, sizeof(body), state));
+}
+
+int StatusQueueBody(struct MHD_Connection* conn, const char* body, int len) {
+	if (len < 0) {
+		return MHD_NO;
+	}
+
+	return StatusQueueResponse(conn, MHD_HTTP_OK, create_response(body, len, MHD_RESPMEM_MUST_COPY));
+}
+
+int StatusQueueOwned(struct MHD_Connection* conn, char* body, size_t len) {
+	struct MHD_Response* res = create_response(body, len, MHD_RESPMEM_MUST_FREE);
+	if (res == NULL) {
+		free(body);
+		return MHD_NO;
+	}
+	return StatusQueueResponse(conn, MHD_HTTP_OK, res);
+}
@@ -0,0 +1,56 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <microhttpd.h>
+
+#include "state.h"
+
+// Cached /status response.
+//
+// heartThread renders the snapshot once per cycle into a shared
+// MHD_Response; handlers queue that same response so the hot path does
+// no formatting and no allocation.  MHD reference counts the response,
+// so a request still being sent keeps the previous version alive.
+
+void StatusSetup(bool keepAlive);
+
+// snprintf onto the end of buf at *len, false once the output no longer fits
+bool StatusAppend(char* buf, size_t size, size_t* len, const char* fmt, ...);
+
+// Appends text as a quoted JSON string, escaping what needs it
+bool StatusAppendString(char* buf, size_t size, size_t* len, const char* text);
+
+// Formats state as the Homekit status JSON, returns the length written
+int StatusRender(char* buf, size_t size, const BBQState* state);
+
+// Re-renders the cached response if the snapshot content changed
+void StatusUpdate(const BBQState* state);
+
+// Queues the cached response, MHD_NO if nothing has been published yet
+int StatusQueue(struct MHD_Connection* conn);
+
+// Queues the cached response, or a body-less 304 when the request's
+// If-None-Match carries its ETag.  MHD_NO if nothing was published yet.
+int StatusQueueConditional(struct MHD_Connection* conn);
+
+// Queues {"error": message} with the given HTTP status
+int StatusQueueError(struct MHD_Connection* conn, unsigned int code, const char* message);
+
+// Queues a one-off response and drops our reference to it.  Every reply
+// but the cached one goes through here so Connection: close is added
+// when keep-alive is off.  MHD_NO for a NULL res.
+int StatusQueueResponse(struct MHD_Connection* conn, unsigned int code, struct MHD_Response* res);
+
+// Queues a one-off response for state, used when the cache is stale
+int StatusQueueState(struct MHD_Connection* conn, const BBQState* state);
+
+// Queues a copy of a JSON body with the same headers as /status
+int StatusQueueBody(struct MHD_Connection* conn, const char* body, int len);
+
+// Queues a malloc'd JSON body, MHD frees it once sent
+int StatusQueueOwned(struct MHD_Connection* conn, char* body, size_t len);
+
+#endif
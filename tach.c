@@ -0,0 +1,159 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hal.h"
+#include "log.h"
+#include "tach.h"
+
+
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+static TachConfig config;
+static const TachBackend* backend;
+
+// Interrupt to heartThread ring
+static uint64_t ring[TACH_RING_SIZE];
+static atomic_uint ringHead;	// written by the producer
+static atomic_uint ringTail;	// written by the consumer
+static atomic_ulong dropped;
+
+// Consumer state, only touched by TachUpdate
+static uint64_t window[TACH_WINDOW_SIZE];
+static unsigned int windowHead;
+static unsigned int windowFill;
+static uint64_t lastEdge;
+static uint64_t drivenSince;
+static unsigned long edges;
+static unsigned long bounced;
+
+uint64_t TachNow(void) {
+	return HalNow();
+}
+
+void TachConfigure(const TachConfig* tachConfig) {
+	config = *tachConfig;
+	if (config.pulsesPerRev < 1) {
+		config.pulsesPerRev = 1;
+	}
+}
+
+void TachSetup(const TachConfig* tachConfig) {
+	TachConfigure(tachConfig);
+
+	atomic_store(&ringHead, 0);
+	atomic_store(&ringTail, 0);
+	atomic_store(&dropped, 0);
+
+	windowHead = windowFill = 0;
+	lastEdge = drivenSince = 0;
+	edges = bounced = 0;
+}
+
+const TachBackend* TachStart(const TachBackend* preferred, const TachPins* pins) {
+	backend = NULL;
+
+	if (preferred && preferred->start(pins)) {
+		backend = preferred;
+	} else if (preferred != &TachBackendWiringPi && TachBackendWiringPi.start(pins)) {
+		if (preferred) Log(LOG_LEVEL_WARN, "tach : %s backend unavailable, using %s", preferred->name, TachBackendWiringPi.name);
+		backend = &TachBackendWiringPi;
+	}
+
+	return backend;
+}
+
+void TachStop(void) {
+	if (backend) {
+		backend->stop();
+		backend = NULL;
+	}
+}
+
+void TachEdgeAt(uint64_t ns) {
+	unsigned int head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&ringTail, memory_order_acquire);
+
+	if (head - tail >= TACH_RING_SIZE) {
+		atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	ring[head & (TACH_RING_SIZE - 1)] = ns;
+	atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+}
+
+void TachEdge(void) {
+	TachEdgeAt(TachNow());
+}
+
+static void accept_edge(uint64_t ns) {
+	if (lastEdge != 0 && ns - lastEdge < config.debounceUs * NSEC_PER_USEC) {
+		bounced++;
+		return;
+	}
+
+	lastEdge = ns;
+	edges++;
+
+	window[windowHead] = ns;
+	windowHead = (windowHead + 1) % TACH_WINDOW_SIZE;
+	if (windowFill < TACH_WINDOW_SIZE) {
+		windowFill++;
+	}
+}
+
+void TachUpdate(double duty, TachReading* reading) {
+	if (backend) {
+		backend->poll();
+	}
+
+	unsigned int tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&ringHead, memory_order_acquire);
+
+	for (; tail != head; tail++) {
+		accept_edge(ring[tail & (TACH_RING_SIZE - 1)]);
+	}
+	atomic_store_explicit(&ringTail, tail, memory_order_release);
+
+	uint64_t now = TachNow();
+	uint64_t horizon = now - config.windowMs * NSEC_PER_MSEC;
+
+	// Age out the oldest pulses, the newest sits just before windowHead
+	while (windowFill > 0) {
+		unsigned int oldest = (windowHead + TACH_WINDOW_SIZE - windowFill) % TACH_WINDOW_SIZE;
+		if (window[oldest] >= horizon) {
+			break;
+		}
+		windowFill--;
+	}
+
+	reading->rpm = 0.0;
+	if (windowFill >= 2) {
+		unsigned int oldest = (windowHead + TACH_WINDOW_SIZE - windowFill) % TACH_WINDOW_SIZE;
+		unsigned int newest = (windowHead + TACH_WINDOW_SIZE - 1) % TACH_WINDOW_SIZE;
+		double span = (window[newest] - window[oldest]) / 1e9;
+
+		if (span > 0.0) {
+			reading->rpm = (windowFill - 1) / span / config.pulsesPerRev * 60.0;
+		}
+	}
+
+	// Stalled once driven for stallMs without a single pulse in that time
+	if (duty > config.stallDuty) {
+		if (drivenSince == 0) {
+			drivenSince = now;
+		}
+	} else {
+		drivenSince = 0;
+	}
+
+	uint64_t stall = config.stallMs * NSEC_PER_MSEC;
+	reading->stalled = drivenSince != 0 && now - drivenSince >= stall
+		&& (lastEdge == 0 || now - lastEdge >= stall);
+
+	reading->edges = edges;
+	reading->bounced = bounced;
+	reading->dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+}
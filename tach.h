@@ -0,0 +1,75 @@
+#ifndef TACH_H
+#define TACH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fan tachometer.
+//
+// A backend timestamps each pulse on HalNow() and pushes it into a
+// single producer / single consumer ring.  heartThread polls the backend
+// and drains the ring once per cycle, drops contact bounce and computes
+// RPM over a sliding window of pulses.
+
+#define TACH_RING_SIZE   256	// power of two, pending edges between two cycles
+#define TACH_WINDOW_SIZE 512	// accepted edges kept for the RPM window
+
+typedef struct TachConfig {
+	int	pulsesPerRev;
+	long	debounceUs;	// edges closer than this to the last accepted edge are bounce
+	long	windowMs;	// RPM is averaged over the pulses seen in this window
+	long	stallMs;	// no pulses for this long while driven counts as a stall
+	double	stallDuty;	// duty in % above which the fan is expected to turn
+} TachConfig;
+
+typedef struct TachReading {
+	double		rpm;
+	bool		stalled;
+	unsigned long	edges;		// accepted edges since setup
+	unsigned long	bounced;	// edges rejected by the debounce
+	unsigned long	dropped;	// edges lost because the ring was full
+} TachReading;
+
+
+typedef struct TachPins {
+	int		wiringPiPin;	// pin as numbered by wiringPi
+	const char*	chip;		// gpio character device for the gpiod backend
+	int		line;		// line offset on chip, the BCM number on a Pi
+} TachPins;
+
+// Where edges come from.  poll runs on the heartThread just before the
+// ring is drained, backends that deliver from interrupt context leave it
+// empty.
+typedef struct TachBackend {
+	const char*	name;
+	bool	(*start)(const TachPins* pins);
+	void	(*poll)(void);
+	void	(*stop)(void);
+} TachBackend;
+
+extern const TachBackend TachBackendWiringPi;	// wiringPiISR, one wake up per edge
+extern const TachBackend TachBackendGpiod;	// libgpiod v2 edge events read in batches
+
+
+void TachSetup(const TachConfig* config);
+
+// Replaces the config without touching the pulse history, for changes at
+// run time.  Same thread as TachUpdate.
+void TachConfigure(const TachConfig* config);
+
+// Starts the preferred backend, falling back to wiringPi when it fails.
+// Returns the backend in use or NULL if none could start.
+const TachBackend* TachStart(const TachBackend* preferred, const TachPins* pins);
+void TachStop(void);
+
+// Producer side, safe to call from the edge interrupt
+void TachEdge(void);
+void TachEdgeAt(uint64_t ns);
+
+// Consumer side, polls the backend, drains pending edges and refreshes reading.  duty is the
+// currently commanded fan duty, used for stall detection.
+void TachUpdate(double duty, TachReading* reading);
+
+uint64_t TachNow(void);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+
+#include "log.h"
+#include "tach.h"
+
+
+// libgpiod v2 backend.  The kernel timestamps every edge and queues it, so
+// a whole cycle worth of pulses is collected with one read instead of a
+// userspace wake up per edge.  Built when HAVE_GPIOD is defined.
+
+#ifdef HAVE_GPIOD
+
+#include <gpiod.h>
+
+#define GPIOD_KERNEL_EVENTS 1024	// edges the kernel holds between two polls
+#define GPIOD_BATCH         64		// edges read per syscall
+
+static struct gpiod_chip* chip;
+static struct gpiod_line_request* request;
+static struct gpiod_edge_event_buffer* events;
+
+static void gpiod_stop(void) {
+	if (events) gpiod_edge_event_buffer_free(events);
+	if (request) gpiod_line_request_release(request);
+	if (chip) gpiod_chip_close(chip);
+
+	events = NULL;
+	request = NULL;
+	chip = NULL;
+}
+
+static bool gpiod_start(const TachPins* pins) {
+	unsigned int offset = pins->line;
+	struct gpiod_line_settings* settings = NULL;
+	struct gpiod_line_config* lineConfig = NULL;
+	struct gpiod_request_config* requestConfig = NULL;
+
+	chip = gpiod_chip_open(pins->chip);
+	if (chip == NULL) {
+		Log(LOG_LEVEL_WARN, "tach : can't open %s", pins->chip);
+		return false;
+	}
+
+	settings = gpiod_line_settings_new();
+	lineConfig = gpiod_line_config_new();
+	requestConfig = gpiod_request_config_new();
+
+	if (settings && lineConfig && requestConfig) {
+		gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_INPUT);
+		gpiod_line_settings_set_edge_detection(settings, GPIOD_LINE_EDGE_RISING);
+		gpiod_line_settings_set_bias(settings, GPIOD_LINE_BIAS_PULL_DOWN);
+		gpiod_line_settings_set_event_clock(settings, GPIOD_LINE_CLOCK_MONOTONIC);
+
+		gpiod_request_config_set_consumer(requestConfig, "bbq-tach");
+		gpiod_request_config_set_event_buffer_size(requestConfig, GPIOD_KERNEL_EVENTS);
+
+		if (gpiod_line_config_add_line_settings(lineConfig, &offset, 1, settings) == 0) {
+			request = gpiod_chip_request_lines(chip, requestConfig, lineConfig);
+		}
+	}
+
+	if (requestConfig) gpiod_request_config_free(requestConfig);
+	if (lineConfig) gpiod_line_config_free(lineConfig);
+	if (settings) gpiod_line_settings_free(settings);
+
+	if (request) {
+		events = gpiod_edge_event_buffer_new(GPIOD_BATCH);
+	}
+
+	if (request == NULL || events == NULL) {
+		Log(LOG_LEVEL_WARN, "tach : can't request line %d on %s", pins->line, pins->chip);
+		gpiod_stop();
+		return false;
+	}
+
+	return true;
+}
+
+static void gpiod_poll(void) {
+	if (request == NULL) {
+		return;
+	}
+
+	// Zero timeout, only collect what the kernel already queued
+	while (gpiod_line_request_wait_edge_events(request, 0) > 0) {
+		int n = gpiod_line_request_read_edge_events(request, events, GPIOD_BATCH);
+		if (n <= 0) {
+			break;
+		}
+
+		for (int i = 0; i < n; i++) {
+			TachEdgeAt(gpiod_edge_event_get_timestamp_ns(gpiod_edge_event_buffer_get_event(events, i)));
+		}
+	}
+}
+
+#else
+
+static bool gpiod_start(const TachPins* pins) {
+	Log(LOG_LEVEL_WARN, "tach : built without libgpiod (make GPIOD=1)");
+	return false;
+}
+
+static void gpiod_poll(void) {
+}
+
+static void gpiod_stop(void) {
+}
+
+#endif
+
+const TachBackend TachBackendGpiod = {
+	"gpiod", gpiod_start, gpiod_poll, gpiod_stop
+};
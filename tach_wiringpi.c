@@ -0,0 +1,23 @@
+#include "hal.h"
+#include "tach.h"
+
+
+// One wiringPi interrupt thread wake up per edge through the HAL, the
+// fallback when the kernel edge event interface is not available.  Under
+// SIM the simulated fan delivers its edges here.
+
+static bool wiringpi_start(const TachPins* pins) {
+	return HalEdgeIsr(pins->wiringPiPin, &TachEdgeAt) == 0;
+}
+
+static void wiringpi_poll(void) {
+	// edges are pushed straight from the interrupt thread
+}
+
+static void wiringpi_stop(void) {
+	// wiringPi offers no way to cancel an ISR, edges simply stop being read
+}
+
+const TachBackend TachBackendWiringPi = {
+	"wiringpi", wiringpi_start, wiringpi_poll, wiringpi_stop
+};
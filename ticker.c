@@ -0,0 +1,42 @@
+#include "hal.h"
+#include "ticker.h"
+
+
+void TickerSetPeriod(Ticker* ticker, int periodMs) {
+	if (periodMs < TICKER_MIN_PERIOD_MS) {
+		periodMs = TICKER_MIN_PERIOD_MS;
+	}
+	ticker->periodNs = periodMs * (int64_t)1000000;
+}
+
+void TickerStart(Ticker* ticker, int periodMs) {
+	TickerSetPeriod(ticker, periodMs);
+	ticker->ticks = 0;
+	ticker->overruns = 0;
+	ticker->jitterNs = 0;
+	ticker->maxJitterNs = 0;
+
+	ticker->deadline = HalNow();
+}
+
+void TickerWait(Ticker* ticker) {
+	ticker->deadline += ticker->periodNs;
+
+	uint64_t now = HalNow();
+	int64_t late = (int64_t)(now - ticker->deadline);
+
+	if (late > 0) {
+		// The cycle itself ran past the deadline, realign on now
+		ticker->overruns += 1 + late / ticker->periodNs;
+		ticker->jitterNs = late;
+		ticker->deadline = now;
+	} else {
+		HalSleepUntil(ticker->deadline);
+		ticker->jitterNs = (int64_t)(HalNow() - ticker->deadline);
+	}
+
+	if (ticker->jitterNs > ticker->maxJitterNs) {
+		ticker->maxJitterNs = ticker->jitterNs;
+	}
+	ticker->ticks++;
+}
@@ -0,0 +1,31 @@
+#ifndef TICKER_H
+#define TICKER_H
+
+#include <stdint.h>
+
+// Fixed period scheduler for the control loop.
+//
+// Deadlines are absolute on HalNow() so the time spent doing the
+// work inside a cycle does not stretch the period.  A cycle that wakes
+// after its next deadline has already passed counts as an overrun and the
+// schedule skips ahead instead of bursting to catch up.
+
+#define TICKER_MIN_PERIOD_MS 100
+
+typedef struct Ticker {
+	int64_t		periodNs;	// 64 bit, a long overflows past 2.1 s on a 32 bit Pi
+	uint64_t	deadline;	// HalNow() of the next wake up
+	unsigned long	ticks;
+	unsigned long	overruns;
+	int64_t		jitterNs;	// wake up latency of the last cycle
+	int64_t		maxJitterNs;
+} Ticker;
+
+
+void TickerStart(Ticker* ticker, int periodMs);
+void TickerSetPeriod(Ticker* ticker, int periodMs);
+
+// Sleeps until the next deadline and updates the timing statistics
+void TickerWait(Ticker* ticker);
+
+#endif